@@ -1,13 +1,31 @@
 // main.c
-// NAV_PLAYER: Home/stories announcements + interruptible playback (fixed stop_flag + notifications + volume)
-// - Plays welcome.wav then home.wav on boot
+// NAV_PLAYER: Home/stories announcements + interruptible playback (lock-free command ring + volume)
+// - Boot is staged: inputs and the audio engine come up first, card_task mounts the card and loads its
+//   catalog on the other core, and welcome.wav then home.wav are queued as interruptible announcements
 // - When at HOME, selecting stories folder auto-plays stories.wav
 // - Entering stories folder: announcements for S1..S5 (story1.wav..story5.wav) play on selection
-// - Announcements interrupt normal playback; user interactions interrupt announcements
-// - Uses FreeRTOS notifications for play commands; encoder uses ISR + queue
+// - Announcements are mixed over a playing story, which is ducked and keeps its place;
+//   outside a story they interrupt playback, and user interactions interrupt announcements
+// - nav_task runs a table-driven HOME/FOLDER_VIEW/FILE_VIEW state machine over one event queue
+//   (button ISRs, PCNT encoder with velocity acceleration, playback events from audio_task) and
+//   posts typed commands to the audio engine (components/noor_audio) through its lock-free MPSC ring
+// - I2S runs at one fixed stereo rate; a conversion stage resamples/upmixes every source to it
+// - Folders are scanned by a low-priority worker; tracks appear (naturally sorted) as their headers
+//   are read, so the first one is selectable and announced while the rest of the folder loads
+// - Finished tracks auto-advance, chained gaplessly with the next file prefetched
+// - Plays 8/16/24/32-bit PCM and IMA-ADPCM WAV through a pluggable decoder stage
+// - Tracks resume where they stopped (positions batched to NVS); SEEK is one unit-aligned fseek
+// - Cards can be swapped at any time: card_task notices removal (card-detect pin or CMD13) and
+//   remounts in the background; a card seen before is re-validated against its catalog kept in RAM
+// - Mount, catalog index and natural-order listings come from components/noor_card (shared with noor_bench)
+// - The I2S writer has core 1 to itself; UI, storage and log output run on core 0 (menuconfig), and log
+//   lines go through a RAM ring to a low-priority task so no hot path waits for the UART
+// - Latency histograms, underrun counters, the DMA deadline-miss rate and an event trace are always
+//   collected; `stats` on the console dumps them with per-task core, CPU time and stack headroom
+// - Full clocks only while streaming (esp_pm lock); idle drops to DFS minimum / light sleep with GPIO wakeup
 //
 // Pins: I2S BCLK=18 WS=17 DIN=16
-// SD SPI: CS=10 MOSI=11 SCK=12 MISO=13
+// SD SPI: CS=10 MOSI=11 SCK=12 MISO=13 (SDMMC option: CLK=12 CMD=11 D0=13 D1=9 D2=8 D3=10, see menuconfig)
 // Buttons: PlayPause=14 Home=15 Vol+=4 Vol-=5 (active HIGH, pull-down)
 // Encoder: CLK=1 DT=2 SW=21 (change if needed)
 
@@ -18,20 +36,28 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdarg.h>
+#include <stdatomic.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <ctype.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/ringbuf.h"
 #include "driver/gpio.h"
-#include "driver/i2s.h"
+#include "driver/pulse_cnt.h"
 #include "esp_log.h"
 #include "esp_vfs_fat.h"
 #include "sdmmc_cmd.h"
-#include "driver/spi_common.h"
-#include "driver/spi_master.h"
-#include "driver/sdspi_host.h"
+#include "esp_timer.h"
+#include "esp_pm.h"
+#include "esp_sleep.h"
+#include "esp_heap_caps.h"
+#include "esp_console.h"
+#include "noor_audio.h"
+#include "noor_card.h"
 
 static const char *TAG = "NAV_PLAYER_RTOS";
 
@@ -45,6 +71,18 @@ static const char *TAG = "NAV_PLAYER_RTOS";
 #define PIN_NUM_CLK  12
 #define PIN_NUM_CS   10
 
+// SDMMC host (NOOR_SD_SDMMC): CLK/CMD/D0/D3 sit on the SPI lines above, D1/D2 need two more
+#ifdef CONFIG_NOOR_SD_SDMMC
+#define PIN_SD_CLK   CONFIG_NOOR_SD_PIN_CLK
+#define PIN_SD_CMD   CONFIG_NOOR_SD_PIN_CMD
+#define PIN_SD_D0    CONFIG_NOOR_SD_PIN_D0
+#ifdef CONFIG_NOOR_SD_SDMMC_4BIT
+#define PIN_SD_D1    CONFIG_NOOR_SD_PIN_D1
+#define PIN_SD_D2    CONFIG_NOOR_SD_PIN_D2
+#define PIN_SD_D3    CONFIG_NOOR_SD_PIN_D3
+#endif
+#endif
+
 #define BTN_PLAY_PAUSE_PIN 14
 #define BTN_HOME_PIN       15
 #define BTN_VOL_UP_PIN     4
@@ -56,167 +94,597 @@ static const char *TAG = "NAV_PLAYER_RTOS";
 
 /* ---------- Settings ---------- */
 #define DEBOUNCE_MS 50
-#define ENC_STEP_DEBOUNCE_MS 60
+#define ENC_COUNTS_PER_DETENT 4    // PCNT counts every edge of both lines
+#define ENC_GLITCH_NS       10000  // PCNT filter; pulses shorter than this are contact noise
+#define ENC_PCNT_LIMIT      10000
+#define ENC_POLL_MS         20     // PCNT read interval while the knob turns
+#define ENC_IDLE_MS         300    // still this long -> back to waiting on the watch point
+#define ENC_ACCEL_MED_DPS   10     // detents/s for 2x steps
+#define ENC_ACCEL_MED_MUL   2
+#define ENC_ACCEL_FAST_DPS  25     // detents/s for 4x steps
+#define ENC_ACCEL_FAST_MUL  4
+#ifdef CONFIG_NOOR_MAX_TRACKS
+#define MAX_WAV_FILES CONFIG_NOOR_MAX_TRACKS
+#define MAX_FOLDERS   CONFIG_NOOR_MAX_FOLDERS
+#define LIST_PATH_BYTES CONFIG_NOOR_LIST_PATH_BYTES
+#else
 #define MAX_WAV_FILES 64
 #define MAX_FOLDERS 32
-#define ENC_QUEUE_LEN 16
+#define LIST_PATH_BYTES 96   // average arena bytes reserved per list entry (full path + NUL)
+#endif
+#if CONFIG_NOOR_LIST_ARENA_PSRAM
+#define LIST_ARENA_PSRAM true
+#else
+#define LIST_ARENA_PSRAM false
+#endif
+#define INPUT_QUEUE_LEN 16
+#define NAV_SYNC_TIMEOUT_MS 2000   // longest wait for the engine to let go of the track list
 #define ANNOUNCE_PATH_MAX 256
+#define SD_MOUNT_POINT    "/sdcard"
+#ifdef CONFIG_NOOR_SD_FREQ_KHZ
+#define SD_FREQ_KHZ       CONFIG_NOOR_SD_FREQ_KHZ
+#define SD_MAX_FILES      CONFIG_NOOR_SD_MAX_FILES
+#define SD_SELFTEST_KB    CONFIG_NOOR_SD_SELFTEST_KB
+#define SD_PIN_CD         CONFIG_NOOR_SD_PIN_CD
+#define SD_POLL_MS        CONFIG_NOOR_SD_POLL_MS
+#define SD_CARD_BANKS     CONFIG_NOOR_SD_CARD_BANKS
+#else
+#define SD_FREQ_KHZ       20000   // SDSPI default clock
+#define SD_MAX_FILES      5       // playing + chained + catalog/scan
+#define SD_SELFTEST_KB    0       // raw read benchmark at boot, 0 = off
+#define SD_PIN_CD         -1      // no card-detect switch: poll the card
+#define SD_POLL_MS        1000
+#define SD_CARD_BANKS     4       // catalogs kept for removed cards
+#endif
+#ifdef CONFIG_NOOR_SD_SPI_MAX_TRANSFER
+#define SD_SPI_MAX_TRANSFER CONFIG_NOOR_SD_SPI_MAX_TRANSFER
+#else
+#define SD_SPI_MAX_TRANSFER 4000  // bytes per SPI DMA transaction
+#endif
+#ifdef CONFIG_NOOR_SD_SDMMC_1BIT
+#define SD_SDMMC_WIDTH    1
+#else
+#define SD_SDMMC_WIDTH    4
+#endif
+#define CATALOG_PATH      SD_MOUNT_POINT "/.noor_index"
 
-/* ---------- Notifications ---------- */
-#define NOTIFY_ANNOUNCE_BIT (1u<<31)  // set bits to request audio_task handle announcement
-// play request uses numeric payload = (track_index + 1) as full 32-bit value via eSetValueWithOverwrite
+/* ---------- Tasks ---------- */
+// The engine's I2S writer has core 1 to itself at the highest priority (noor_audio "Tasks" menu);
+// UI, storage and log output share core 0 with the SD reader. Core -1 = no affinity.
+#ifdef CONFIG_NOOR_NAV_TASK_PRIO
+#define NAV_TASK_PRIO     CONFIG_NOOR_NAV_TASK_PRIO
+#define NAV_TASK_CORE     CONFIG_NOOR_NAV_TASK_CORE
+#define SCAN_TASK_PRIO    CONFIG_NOOR_SCAN_TASK_PRIO
+#define SCAN_TASK_CORE    CONFIG_NOOR_SCAN_TASK_CORE
+#define CARD_TASK_PRIO    CONFIG_NOOR_CARD_TASK_PRIO
+#define CARD_TASK_CORE    CONFIG_NOOR_CARD_TASK_CORE
+#else
+#define NAV_TASK_PRIO     3
+#define NAV_TASK_CORE     0
+#define SCAN_TASK_PRIO    1           // folder scans only use time nobody else wants
+#define SCAN_TASK_CORE    0
+#define CARD_TASK_PRIO    1
+#define CARD_TASK_CORE    0           // mount and catalog next to the SD reader, off the engine's core
+#endif
+#ifdef CONFIG_NOOR_LOG_TASK_PRIO
+#define LOG_BUF_BYTES     (CONFIG_NOOR_LOG_BUF_KB * 1024)
+#define LOG_TASK_PRIO     CONFIG_NOOR_LOG_TASK_PRIO
+#define LOG_TASK_CORE     CONFIG_NOOR_LOG_TASK_CORE
+#else
+#define LOG_BUF_BYTES     (8 * 1024)
+#define LOG_TASK_PRIO     1
+#define LOG_TASK_CORE     0           // also the stats console's core
+#endif
+#define LOG_LINE_MAX      256         // longer lines are cut
+#define SCAN_RESULT_LEN   8           // tracks in flight between scan_task and nav_task
+#define TASK_CORE(c)      ((c) < 0 ? tskNO_AFFINITY : (c))
 
 /* ---------- Navigation ---------- */
-typedef enum { NAV_HOME=0, NAV_FOLDER_VIEW, NAV_FILE_VIEW } nav_state_t;
-static volatile nav_state_t nav_state = NAV_HOME;
-
-/* ---------- Controls ---------- */
-static volatile bool g_pause = false;          // pause toggle
-static volatile bool g_playing = false;        // playing state (kept for UI/state)
-static volatile int playing_track = -1;        // which track is considered playing
-static volatile int g_volume_percent = 100;    // volume control: 0..200%
+typedef enum { NAV_HOME=0, NAV_FOLDER_VIEW, NAV_FILE_VIEW, NAV_STATE_COUNT } nav_state_t;
+static nav_state_t nav_state = NAV_HOME;   // nav_task only
 
 /* ---------- Lists ---------- */
+// Entries point into a per-list name arena (noor_card): no malloc per entry, and a rescan resets it in O(1).
+static noor_name_arena_t folder_arena;
+static noor_name_arena_t wav_arena;
+
 static char *folder_list[MAX_FOLDERS];
 static int num_folders = 0;
 static int selected_folder = 0;
 
+// The track list is appended to by nav_task only (from scan_task results) and cleared behind the
+// engine STOP barrier; published entries never change, so the engine only takes list_lock to read
+// num_tracks. Path strings stay valid until the next folder is entered.
 static char *wav_list[MAX_WAV_FILES];
+static noor_wav_info_t wav_meta[MAX_WAV_FILES];   // parsed header per track, filled by the scan
+static SemaphoreHandle_t list_lock = NULL;
 static volatile int num_tracks = 0;
-static volatile int current_track = 0;    // selection index inside folder
+static volatile int current_track = 0;    // selection index inside folder (nav_task; audio_task posts EVT_PLAYBACK)
 
 /* ---------- SD mount ---------- */
-esp_vfs_fat_mount_config_t mount_cfg = {
-    .format_if_mount_failed = false,
-    .max_files = 5,
-    .allocation_unit_size = 16 * 1024
+// One bus is compiled in (NOOR_SD_BUS): the SDSPI host on SPI2, or the S3's native SDMMC host in 1- or
+// 4-bit mode. SD_FREQ_KHZ caps the clock for either; the card still negotiates down if it cannot keep up.
+static const noor_card_config_t card_cfg = {
+    .mount_point = SD_MOUNT_POINT,
+    .freq_khz = SD_FREQ_KHZ,
+    .max_files = SD_MAX_FILES,
+    .status_check = (SD_PIN_CD < 0),   // no switch: FATFS asks the card (CMD13) before each access
+#ifdef CONFIG_NOOR_SD_SDMMC
+    .sdmmc_width = SD_SDMMC_WIDTH,
+    .pin_clk = PIN_SD_CLK, .pin_cmd = PIN_SD_CMD, .pin_d0 = PIN_SD_D0,
+#if SD_SDMMC_WIDTH == 4
+    .pin_d1 = PIN_SD_D1, .pin_d2 = PIN_SD_D2, .pin_d3 = PIN_SD_D3,
+#endif
+#endif
+    .pin_miso = PIN_NUM_MISO, .pin_mosi = PIN_NUM_MOSI, .pin_sclk = PIN_NUM_CLK, .pin_cs = PIN_NUM_CS,
+    .spi_max_transfer = SD_SPI_MAX_TRANSFER,
 };
 sdmmc_card_t *sdcard = NULL;
-
-/* ---------- Announcement request / stop flag ---------- */
-static char announce_path[ANNOUNCE_PATH_MAX] = {0};
-/* STOP flag: used to interrupt any currently streaming audio (playback or announcement) */
-static volatile bool stop_flag = false;
+static SemaphoreHandle_t card_lock = NULL;    // held by scan_task per request and by card_task while (un)mounting
+static volatile bool card_mounted = false;
 
 /* ---------- FreeRTOS objects ---------- */
-static QueueHandle_t enc_queue = NULL;
-static TaskHandle_t audio_task_handle = NULL;
+static QueueHandle_t input_queue = NULL;   // encoder and button events, filled from ISRs
 
-/* ---------- Encoder event ---------- */
-typedef enum { ENC_EVT_CLK = 1, ENC_EVT_SW = 2 } enc_evt_type_t;
-typedef struct { enc_evt_type_t type; uint8_t dt_level; } enc_evt_t;
+/* ---------- Input event ---------- */
+typedef enum { EVT_ENC_MOVE = 1, EVT_BUTTON = 2, EVT_PLAYBACK = 3, EVT_SCAN = 4, EVT_CARD = 5 } input_evt_type_t;
+// arg: btn_id_t for EVT_BUTTON, track (-1 = none) for EVT_PLAYBACK; EVT_SCAN: results waiting; EVT_CARD: 1 mounted, 0 gone
+typedef struct { input_evt_type_t type; int16_t arg; } input_evt_t;
 
-/* ---------- Helpers ---------- */
-static inline int16_t clip16(int32_t s) {
-    if (s > 32767) return 32767;
-    if (s < -32768) return -32768;
-    return (int16_t)s;
+// audio_task -> nav_task: the engine moved on to track (auto-advance) or stopped (-1).
+static inline void nav_post_playback(int track) {
+    input_evt_t ev = { .type = EVT_PLAYBACK, .arg = (int16_t)track };
+    if (input_queue) xQueueSend(input_queue, &ev, 0);
 }
 
-static char *make_path(const char *dir, const char *name) {
-    size_t need = strlen(dir) + 1 + strlen(name) + 1;
-    char *p = malloc(need);
-    if (!p) return NULL;
-    sprintf(p, "%s/%s", dir, name);
-    return p;
+
+static bool lists_init(void) {
+    list_lock = xSemaphoreCreateMutex();
+    card_lock = xSemaphoreCreateMutex();
+    bool ok = list_lock && card_lock && noor_arena_init(&folder_arena, MAX_FOLDERS * LIST_PATH_BYTES, LIST_ARENA_PSRAM)
+              && noor_arena_init(&wav_arena, MAX_WAV_FILES * LIST_PATH_BYTES, LIST_ARENA_PSRAM);
+    if (!ok) ESP_LOGE(TAG, "Failed to allocate list arenas");
+    return ok;
 }
 
 static void free_folder_list(void) {
-    for (int i = 0; i < num_folders; ++i) { free(folder_list[i]); folder_list[i] = NULL; }
+    noor_arena_reset(&folder_arena);
     num_folders = 0; selected_folder = 0;
 }
-static void free_wav_list(void) {
-    for (int i = 0; i < num_tracks; ++i) { free(wav_list[i]); wav_list[i] = NULL; }
-    num_tracks = 0; current_track = 0;
+
+/* ---------- Catalog index (/sdcard/.noor_index) ---------- */
+// Folders, tracks and their parsed WAV headers for the mounted card (noor_card keeps it in PSRAM and
+// mirrors it to CATALOG_PATH). Loaded by card_task on mount; folder entry then never touches the
+// directory tree.
+static noor_catalog_t catalog;
+static bool catalog_ready = false;
+
+// Re-validate the card's catalog, starting from seed (taken over) or from its index file.
+static void catalog_refresh(noor_catalog_t *seed) {
+    if (noor_catalog_refresh(&catalog, SD_MOUNT_POINT, CATALOG_PATH, seed, MAX_FOLDERS, MAX_WAV_FILES)) catalog_ready = true;
+}
+
+// Fill folder_list from the catalog. Returns false if there is no catalog for this root.
+static bool catalog_fill_folders(const char *root) {
+    if (!catalog_ready || strcmp(root, SD_MOUNT_POINT) != 0) return false;
+    for (int i = 0; i < catalog.num_folders && num_folders < MAX_FOLDERS; ++i) {
+        char *full = noor_arena_path(&folder_arena, root, noor_cat_str(&catalog, catalog.folders[i].name_off));
+        if (!full) break;
+        folder_list[num_folders++] = full;
+    }
+    return true;
+}
+
+// Catalog entry for a folder under the card root, or NULL if it is not indexed.
+static const noor_cat_folder_t *cat_folder_for(const char *folder_path) {
+    size_t root_len = strlen(SD_MOUNT_POINT);
+    if (!catalog_ready || strncmp(folder_path, SD_MOUNT_POINT, root_len) != 0 || folder_path[root_len] != '/') return NULL;
+    return noor_cat_find_folder(&catalog, folder_path + root_len + 1);
+}
+
+/* ---------- Card banks (catalogs of removed cards, keyed by CID) ---------- */
+// When a card goes, its catalog moves here instead of being freed, with a stamp of the card's index
+// file. If the same card (CID) comes back and its index file is still the one that was stamped, the
+// kept catalog replaces the index read; either way the card goes through catalog_refresh(), so the
+// root and every folder are re-listed and each file's size and FAT time checked before anything is used.
+// An index rewritten in between (another player) is newer than the bank and is loaded instead.
+typedef struct {
+    bool used;
+    sdmmc_cid_t cid;
+    noor_cat_stamp_t index;      // CATALOG_PATH when the card was removed
+    uint32_t last_used;
+    noor_catalog_t cat;
+} card_bank_t;
+
+#if SD_CARD_BANKS > 0
+static card_bank_t card_banks[SD_CARD_BANKS];
+#endif
+static uint32_t card_bank_clock = 0;
+static sdmmc_cid_t card_cid;            // mounted card
+
+#if SD_CARD_BANKS > 0
+static bool card_cid_eq(const sdmmc_cid_t *a, const sdmmc_cid_t *b) {
+    return a->mfg_id == b->mfg_id && a->oem_id == b->oem_id && a->serial == b->serial && a->revision == b->revision
+           && a->date == b->date && !strncmp(a->name, b->name, sizeof(a->name));
+}
+#endif
+
+static card_bank_t *card_bank_find(const sdmmc_cid_t *cid) {
+#if SD_CARD_BANKS > 0
+    for (int i = 0; i < SD_CARD_BANKS; ++i) if (card_banks[i].used && card_cid_eq(&card_banks[i].cid, cid)) return &card_banks[i];
+#endif
+    return NULL;
+}
+
+// Hand the mounted card's catalog to a bank (the least recently used one is dropped when all are taken).
+static void card_bank_store(void) {
+    card_bank_t *b = card_bank_find(&card_cid);
+#if SD_CARD_BANKS > 0
+    for (int i = 0; i < SD_CARD_BANKS && !b; ++i) if (!card_banks[i].used) b = &card_banks[i];
+    if (!b) {
+        b = &card_banks[0];
+        for (int i = 1; i < SD_CARD_BANKS; ++i) if (card_banks[i].last_used < b->last_used) b = &card_banks[i];
+    }
+#endif
+    if (!b || !catalog_ready) { noor_catalog_free(&catalog); catalog_ready = false; return; }
+    if (b->used) noor_catalog_free(&b->cat);
+    *b = (card_bank_t){ .used = true, .cid = card_cid, .index = noor_catalog_stamp(CATALOG_PATH), .last_used = ++card_bank_clock, .cat = catalog };
+    memset(&catalog, 0, sizeof(catalog));
+    catalog_ready = false;
+}
+
+// Bring the catalog in line with the card that was just mounted.
+static void card_attach(void) {
+    card_cid = sdcard->cid;
+    card_bank_t *b = card_bank_find(&card_cid);
+    if (!b) { catalog_refresh(NULL); return; }
+    noor_cat_stamp_t now = noor_catalog_stamp(CATALOG_PATH);
+    if (noor_cat_stamp_eq(&b->index, &now)) {
+        ESP_LOGI(TAG, "Card %s #%08x known: re-validating its kept catalog", card_cid.name, (unsigned)card_cid.serial);
+        catalog_refresh(&b->cat);
+    } else {
+        noor_catalog_free(&b->cat);   // index rewritten elsewhere: it is newer than the bank
+        catalog_refresh(NULL);
+    }
+    memset(b, 0, sizeof(*b));
+}
+
+/* ---------- Announcement resolver ---------- */
+// Maps folders and tracks to their announcement clip once per scan, so input handlers resolve a
+// selection with an array lookup instead of access() probes over SPI. Clips are identified by a small
+// id; root clips come first, entries for the current folder's tracks follow ann_track_base, are
+// appended as the scan publishes tracks and are dropped when the track list is cleared.
+typedef int16_t ann_id_t;
+#define ANN_NONE        (-1)
+#define ANN_MAX_CLIPS   (16 + MAX_FOLDERS + MAX_WAV_FILES)
+#define ANN_STORY_MAX   9             // S<d> -> story<d>.wav, single digit as before
+
+static const char *ann_paths[ANN_MAX_CLIPS];
+static int ann_count = 0;
+static int ann_track_base = 0;
+static size_t ann_arena_track_mark = 0;
+static noor_name_arena_t ann_arena;
+static ann_id_t ann_home = ANN_NONE, ann_welcome = ANN_NONE, ann_stories = ANN_NONE;
+static ann_id_t ann_story_root[ANN_STORY_MAX + 1];
+static ann_id_t folder_ann[MAX_FOLDERS];
+static ann_id_t track_ann[MAX_WAV_FILES];
+static ann_id_t ann_story_folder[ANN_STORY_MAX + 1];   // story<n>.wav inside the current folder
+
+static ann_id_t ann_add(const char *dir, const char *name) {
+    if (ann_count >= ANN_MAX_CLIPS) return ANN_NONE;
+    if (!ann_arena.base && !noor_arena_init(&ann_arena, ANN_MAX_CLIPS * LIST_PATH_BYTES / 2, LIST_ARENA_PSRAM)) return ANN_NONE;
+    const char *p = noor_arena_path(&ann_arena, dir, name);
+    if (!p) return ANN_NONE;
+    ann_paths[ann_count] = p;
+    return (ann_id_t)ann_count++;
+}
+
+// audio_task side: nav_task appends track clips while a folder is being scanned.
+static const char *ann_path(ann_id_t id) {
+    xSemaphoreTake(list_lock, portMAX_DELAY);
+    const char *p = (id >= 0 && id < ann_count) ? ann_paths[id] : NULL;
+    xSemaphoreGive(list_lock);
+    return p;
+}
+
+static bool is_stories_folder(const char *name) {
+    return strcasecmp(name, "01") == 0 || strcasecmp(name, "stories") == 0;
+}
+
+// S<n>... -> n, or -1 if the track has no story announcement
+static int story_number(const char *track_name) {
+    if ((track_name[0] == 'S' || track_name[0] == 's') && isdigit((unsigned char)track_name[1])) return track_name[1] - '0';
+    return -1;
+}
+
+// story<n>.wav -> n, or -1
+static int story_clip_number(const char *name) {
+    if (!strncasecmp(name, "story", 5) && isdigit((unsigned char)name[5]) && !strcasecmp(name + 6, ".wav")) return name[5] - '0';
+    return -1;
+}
+
+// Is there a file called clip inside folder? Uses the catalog when the folder is indexed, else one probe.
+static bool folder_has_clip(const char *folder_path, const char *clip) {
+    const noor_cat_folder_t *fo = cat_folder_for(folder_path);
+    if (fo) {
+        for (int i = 0; i < fo->num_tracks; ++i) {
+            if (!strcasecmp(noor_cat_str(&catalog, catalog.tracks[fo->first_track + i].name_off), clip)) return true;
+        }
+        return false;
+    }
+    char full[ANNOUNCE_PATH_MAX];
+    return noor_join_path(full, sizeof(full), folder_path, clip) && access(full, F_OK) == 0;
+}
+
+// Root clips + per-folder announcements; call after folder_list is (re)built.
+static void ann_build_root(void) {
+    ann_count = 0;
+    noor_arena_reset(&ann_arena);
+    ann_home = ann_welcome = ann_stories = ANN_NONE;
+    for (int n = 0; n <= ANN_STORY_MAX; ++n) ann_story_root[n] = ANN_NONE;
+    DIR *d = opendir(SD_MOUNT_POINT);   // one listing of the root instead of an access() per clip name
+    struct dirent *e;
+    while (d && (e = readdir(d)) != NULL) {
+        if (!noor_has_wav_ext(e->d_name) || e->d_type == DT_DIR) continue;
+        const char *n = e->d_name;
+        if (!strcasecmp(n, "home.wav")) ann_home = ann_add(SD_MOUNT_POINT, n);
+        else if (!strcasecmp(n, "welcome.wav")) ann_welcome = ann_add(SD_MOUNT_POINT, n);
+        else if (!strcasecmp(n, "stories.wav")) ann_stories = ann_add(SD_MOUNT_POINT, n);
+        else if (story_clip_number(n) >= 0) ann_story_root[story_clip_number(n)] = ann_add(SD_MOUNT_POINT, n);
+    }
+    if (d) closedir(d);
+    for (int i = 0; i < num_folders; ++i) {
+        folder_ann[i] = ANN_NONE;
+        if (!is_stories_folder(noor_base_name(folder_list[i]))) continue;
+        if (ann_stories != ANN_NONE) folder_ann[i] = ann_stories;
+        else if (folder_has_clip(folder_list[i], "stories.wav")) folder_ann[i] = ann_add(folder_list[i], "stories.wav");
+    }
+    ann_track_base = ann_count;
+    ann_arena_track_mark = ann_arena.used;
+}
+
+// Forget every clip (the card went away); call with list_lock held.
+static void ann_clear_all(void) {
+    ann_count = ann_track_base = 0;
+    ann_arena_track_mark = 0;
+    noor_arena_reset(&ann_arena);
+    ann_home = ann_welcome = ann_stories = ANN_NONE;
+}
+
+// Drop the current folder's clips; call with list_lock held when the track list is cleared.
+static void ann_clear_tracks(void) {
+    ann_count = ann_track_base;
+    ann_arena.used = ann_arena_track_mark;
+    for (int n = 0; n <= ANN_STORY_MAX; ++n) ann_story_folder[n] = ANN_NONE;
+}
+
+// Track i was just appended to wav_list (list_lock held): register it if it is a story<n>.wav clip
+// and resolve its own announcement. Ids are only appended, so ids already posted stay valid.
+static void ann_track_added(int i) {
+    const char *name = noor_base_name(wav_list[i]);
+    int n = story_clip_number(name);
+    if (n >= 0 && ann_story_folder[n] == ANN_NONE && ann_count < ANN_MAX_CLIPS) {
+        // story<n>.wav next to the tracks is itself in the list, so no probing is needed
+        ann_story_folder[n] = (ann_id_t)ann_count;
+        ann_paths[ann_count++] = wav_list[i];
+        if (ann_story_root[n] == ANN_NONE) {
+            for (int k = 0; k < i; ++k) if (story_number(noor_base_name(wav_list[k])) == n) track_ann[k] = ann_story_folder[n];   // S<n> sorts before its clip
+        }
+    }
+    n = story_number(name);
+    track_ann[i] = (n < 0) ? ANN_NONE : (ann_story_root[n] != ANN_NONE ? ann_story_root[n] : ann_story_folder[n]);
 }
 
+static inline ann_id_t ann_for_folder(int idx) { return (idx >= 0 && idx < num_folders) ? folder_ann[idx] : ANN_NONE; }
+static inline ann_id_t ann_for_track(int idx) { return (idx >= 0 && idx < num_tracks) ? track_ann[idx] : ANN_NONE; }
+
 /* ---------- File scanning ---------- */
 static void scan_root_folders(const char *path) {
     free_folder_list();
-    DIR *d = opendir(path);
-    if (!d) { ESP_LOGE(TAG, "Failed to open %s", path); return; }
-    struct dirent *entry;
-    int found = 0;
-    while ((entry = readdir(d)) != NULL && found < MAX_FOLDERS) {
-        if (strcmp(entry->d_name, ".")==0 || strcmp(entry->d_name, "..")==0) continue;
-        bool is_dir = false;
-        if (entry->d_type == DT_DIR) is_dir = true;
-        else if (entry->d_type == DT_UNKNOWN) {
-            char *full = make_path(path, entry->d_name);
-            if (!full) break;
-            struct stat sb;
-            if (stat(full, &sb) == 0 && S_ISDIR(sb.st_mode)) is_dir = true;
-            free(full);
-        }
-        if (is_dir) {
-            char *full = make_path(path, entry->d_name);
-            if (!full) break;
-            folder_list[found++] = full;
-            ESP_LOGI(TAG, "Found folder [%d]: %s", found-1, full);
-        }
+    bool from_catalog = catalog_fill_folders(path);
+    if (!from_catalog) {
+        int skipped = 0;
+        int found = noor_list_folders(path, &folder_arena, folder_list, MAX_FOLDERS, &skipped);
+        if (found < 0) { ESP_LOGE(TAG, "Failed to open %s", path); return; }
+        num_folders = found;
+        if (skipped) ESP_LOGW(TAG, "%d folders not listed (limit %d)", skipped, MAX_FOLDERS);
     }
-    closedir(d);
-    num_folders = found;
-    ESP_LOGI(TAG, "Folders found: %d", num_folders);
-}
-
-static void scan_wavs_in_folder(const char *path) {
-    free_wav_list();
-    DIR *d = opendir(path);
-    if (!d) { ESP_LOGE(TAG, "Failed to open folder %s", path); return; }
-    struct dirent *entry;
-    int found = 0;
-    while ((entry = readdir(d)) != NULL && found < MAX_WAV_FILES) {
-        if (strcmp(entry->d_name, ".")==0 || strcmp(entry->d_name, "..")==0) continue;
-        bool is_file = false;
-        if (entry->d_type == DT_REG) is_file = true;
-        else if (entry->d_type == DT_UNKNOWN) {
-            char *full = make_path(path, entry->d_name);
-            if (!full) break;
-            struct stat sb;
-            if (stat(full, &sb) == 0 && S_ISREG(sb.st_mode)) is_file = true;
-            free(full);
+    noor_sort_paths(folder_list, num_folders);
+    for (int i = 0; i < num_folders; ++i) ESP_LOGI(TAG, "Found folder [%d]: %s", i, folder_list[i]);
+    ann_build_root();
+    ESP_LOGI(TAG, "Folders found: %d%s", num_folders, from_catalog ? " (catalog)" : "");
+}
+
+// default selection: prefer "01" -> "audios" -> first
+static void select_default_folder(void) {
+    if (num_folders > 0) {
+        int found_idx = -1;
+        for (int i=0;i<num_folders;++i) {
+            const char *p = strrchr(folder_list[i], '/'); const char *nameptr = p ? p+1 : folder_list[i];
+            if (strcasecmp(nameptr,"01")==0) { found_idx = i; break; }
+            if (found_idx < 0 && strcasecmp(nameptr,"audios")==0) found_idx = i;
         }
-        if (!is_file) continue;
-        const char *name = entry->d_name;
-        size_t n = strlen(name);
-        if (n <= 4) continue;
-        const char *ext = name + (n - 4);
-        if (!strcasecmp(ext, ".wav")) {
-            char *full = make_path(path, name);
-            if (!full) break;
-            wav_list[found++] = full;
-            ESP_LOGI(TAG, "Found WAV [%d]: %s", found-1, full);
+        selected_folder = (found_idx >= 0) ? found_idx : 0;
+        ESP_LOGI(TAG, "Default folder selected: index=%d -> %s", selected_folder, folder_list[selected_folder]);
+    } else ESP_LOGW(TAG, "No folders found at /sdcard");
+}
+
+/* ---------- Background folder scan (scan_task) ---------- */
+// Entering a folder does not wait for the card: nav_task clears the track list and hands the
+// folder to scan_task, which lists it (catalog or readdir), sorts the names naturally (S2 before
+// S10) and then publishes one track at a time with its parsed header. nav_task only appends, so
+// the first track is selectable and announced while later headers are still being read, and no
+// index moves under the engine. Entering another folder or leaving this one bumps scan_gen: the
+// worker stops at the next entry and nav_task drops results from older generations.
+typedef struct { const char *path; uint32_t gen; } scan_req_t;
+typedef struct { uint32_t gen; char *path; noor_wav_info_t info; } scan_result_t;   // path lives in wav_arena
+
+static QueueHandle_t scan_req_q = NULL;   // length 1, newest request wins
+static QueueHandle_t scan_res_q = NULL;
+static atomic_uint scan_gen = 0;          // bumped by nav_task only
+static noor_track_ent_t scan_ents[MAX_WAV_FILES];   // scan_task only
+
+// List the folder's WAVs into scan_ents (catalog headers come along); *skipped counts what did not fit.
+static int scan_list(const char *folder, int *skipped) {
+    int n = noor_list_tracks(folder, &catalog, cat_folder_for(folder), &wav_arena, scan_ents, MAX_WAV_FILES, skipped);
+    if (n < 0) { ESP_LOGE(TAG, "Failed to open folder %s", folder); return 0; }
+    return n;
+}
+
+static void scan_task(void *arg) {
+    scan_req_t req;
+    while (1) {
+        if (xQueueReceive(scan_req_q, &req, portMAX_DELAY) != pdTRUE || req.gen != atomic_load(&scan_gen)) continue;
+        xSemaphoreTake(card_lock, portMAX_DELAY);   // the card stays mounted until this request is done
+        int64_t t0 = esp_timer_get_time();
+        noor_arena_reset(&wav_arena);   // nav_task cleared the list before posting req
+        int skipped = 0;
+        int n = scan_list(req.path, &skipped);
+        int sent = 0;
+        while (sent < n && req.gen == atomic_load(&scan_gen)) {
+            scan_result_t r = { .gen = req.gen, .path = scan_ents[sent].path };
+            if (scan_ents[sent].info) r.info = *scan_ents[sent].info;
+            else noor_read_header(r.path, &r.info);
+            xQueueSend(scan_res_q, &r, portMAX_DELAY);
+            // doorbell only: nav_task drains scan_res_q on every wakeup, so a full input_queue loses nothing
+            input_evt_t ev = { .type = EVT_SCAN, .arg = 0 };
+            xQueueSend(input_queue, &ev, 0);
+            sent++;
         }
+        if (sent < n) ESP_LOGI(TAG, "Scan of %s cancelled after %d/%d", req.path, sent, n);
+        else ESP_LOGI(TAG, "WAV files found: %d in %s%s (%lld ms)", n, req.path, cat_folder_for(req.path) ? " (catalog)" : "",
+                      (long long)((esp_timer_get_time() - t0) / 1000));
+        if (skipped) ESP_LOGW(TAG, "%s: %d WAV files not listed (limit %d)", req.path, skipped, MAX_WAV_FILES);
+        xSemaphoreGive(card_lock);
     }
-    closedir(d);
-    num_tracks = found;
-    ESP_LOGI(TAG, "WAV files found: %d in %s", num_tracks, path);
+}
+
+static bool scan_init(void) {
+    scan_req_q = xQueueCreate(1, sizeof(scan_req_t));
+    scan_res_q = xQueueCreate(SCAN_RESULT_LEN, sizeof(scan_result_t));
+    if (!scan_req_q || !scan_res_q) { ESP_LOGE(TAG, "Failed to create scan queues"); return false; }
+    return xTaskCreatePinnedToCore(scan_task, "scan_task", 4096, NULL, SCAN_TASK_PRIO, NULL, TASK_CORE(SCAN_TASK_CORE)) == pdPASS;
 }
 
 /* ---------- SD init ---------- */
+// Raw sequential read of SD_SELFTEST_KB from the start of the card, below FATFS, in slot-sized
+// requests like the read-ahead task makes; logs what the bus actually delivers.
+static void sd_selftest(void) {
+#if SD_SELFTEST_KB > 0
+    const size_t chunk = NOOR_AUDIO_RD_SLOT_BYTES;
+    const size_t sector = sdcard->csd.sector_size ? sdcard->csd.sector_size : 512;
+    bool dma;
+    uint8_t *buf = noor_audio_buf_alloc(chunk, &dma);   // same kind of memory the read-ahead slots got
+    if (!buf) { ESP_LOGW(TAG, "SD self-test: no buffer"); return; }
+    const size_t total = (size_t)SD_SELFTEST_KB * 1024;
+    size_t done = 0;
+    int64_t t0 = esp_timer_get_time();
+    for (size_t lba = 0; done < total; lba += chunk / sector, done += chunk) {
+        esp_err_t r = sdmmc_read_sectors(sdcard, buf, lba, chunk / sector);
+        if (r != ESP_OK) { ESP_LOGW(TAG, "SD self-test: read at sector %u: %s", (unsigned)lba, esp_err_to_name(r)); break; }
+    }
+    int64_t us = esp_timer_get_time() - t0;
+    heap_caps_free(buf);
+    if (done && us > 0) ESP_LOGI(TAG, "SD self-test: %u KB in %lld ms = %.2f MB/s (%s buffer)", (unsigned)(done / 1024), (long long)(us / 1000),
+                                 (double)done / (double)us, dma ? "DMA" : "PSRAM");
+#endif
+}
+
 static bool init_sd(void) {
-    spi_bus_config_t bus_cfg = {
-        .mosi_io_num = PIN_NUM_MOSI,
-        .miso_io_num = PIN_NUM_MISO,
-        .sclk_io_num = PIN_NUM_CLK,
-        .quadwp_io_num = -1,
-        .quadhd_io_num = -1,
-        .max_transfer_sz = 4000
-    };
-    esp_err_t r = spi_bus_initialize(SPI2_HOST, &bus_cfg, SPI_DMA_CH_AUTO);
-    if (r != ESP_OK) { ESP_LOGE(TAG, "spi_bus_initialize failed: %s", esp_err_to_name(r)); return false; }
-    sdmmc_host_t host = SDSPI_HOST_DEFAULT();
-    sdspi_device_config_t slot_cfg = SDSPI_DEVICE_CONFIG_DEFAULT();
-    slot_cfg.gpio_cs = PIN_NUM_CS;
-    slot_cfg.host_id = SPI2_HOST;
-    r = esp_vfs_fat_sdspi_mount("/sdcard", &host, &slot_cfg, &mount_cfg, &sdcard);
+    esp_err_t r = noor_card_mount(&card_cfg, &sdcard);
     if (r != ESP_OK) { ESP_LOGE(TAG, "Failed to mount SD: %s", esp_err_to_name(r)); return false; }
     sdmmc_card_print_info(stdout, sdcard);
-    ESP_LOGI(TAG, "SD mounted at /sdcard");
+    ESP_LOGI(TAG, "SD mounted at %s", SD_MOUNT_POINT);
+    sd_selftest();
     return true;
 }
 
+/* ---------- Card hot-swap (card_task) ---------- */
+// card_task watches the slot every SD_POLL_MS: the card-detect pin when there is one, else a free-space
+// query that FATFS only answers after checking the card with CMD13 (disk_status_check_enable). It
+// runs under the FATFS volume lock, so it never lands in the middle of another task's transfer.
+// The first card is mounted the same way, straight after boot, while the buttons already work.
+// When the card goes, nav_task drops the lists and has the engine close its files (EVT_CARD 0, acked
+// through the task notification), then the volume is unmounted and its catalog banked. While the slot
+// is empty the mount is retried; a new card is attached here and nav_task rebuilds the root (EVT_CARD
+// 1). Nothing waits for any of it: the buttons keep working and simply find no folders meanwhile.
+#define CARD_ACK_OK   1
+#define CARD_ACK_BUSY 2   // the engine did not confirm; try again next poll
+
+static TaskHandle_t card_task_handle = NULL;
+
+static bool card_present(void) {
+#if SD_PIN_CD >= 0
+    return gpio_get_level(SD_PIN_CD) == 0;
+#else
+    uint64_t total = 0, free_bytes = 0;
+    return esp_vfs_fat_info(SD_MOUNT_POINT, &total, &free_bytes) == ESP_OK;
+#endif
+}
+
+static bool card_post(int mounted) {
+    input_evt_t ev = { .type = EVT_CARD, .arg = (int16_t)mounted };
+    return input_queue && xQueueSend(input_queue, &ev, pdMS_TO_TICKS(SD_POLL_MS)) == pdTRUE;
+}
+
+// nav_task released everything that pointed into the volume; unmount it.
+static void card_detach(void) {
+    xSemaphoreTake(card_lock, portMAX_DELAY);   // a scan still running has seen its generation bumped
+    card_bank_store();
+    esp_err_t r = noor_card_unmount(&card_cfg, sdcard);
+    if (r != ESP_OK) ESP_LOGW(TAG, "SD unmount: %s", esp_err_to_name(r));
+    sdcard = NULL;
+    card_mounted = false;
+    xSemaphoreGive(card_lock);
+    ESP_LOGI(TAG, "SD unmounted, waiting for a card");
+}
+
+static void card_task(void *arg) {
+#if SD_PIN_CD >= 0
+    gpio_config_t cd = { .pin_bit_mask = 1ULL << SD_PIN_CD, .mode = GPIO_MODE_INPUT, .pull_up_en = GPIO_PULLUP_ENABLE,
+                         .pull_down_en = GPIO_PULLDOWN_DISABLE, .intr_type = GPIO_INTR_DISABLE };
+    gpio_config(&cd);
+#endif
+    bool booting = true;   // the first mount attempt reports its failure and runs the self-test
+    TickType_t wait = 0;   // try the slot at once after boot
+    while (1) {
+        vTaskDelay(wait);
+        wait = pdMS_TO_TICKS(SD_POLL_MS);
+        if (card_mounted) {
+            if (card_present()) continue;
+            ESP_LOGW(TAG, "SD card removed or not answering");
+            uint32_t ack = 0;
+            xTaskNotifyWait(0, UINT32_MAX, NULL, 0);   // drop a late ack from an earlier attempt
+            if (!card_post(0) || !xTaskNotifyWait(0, UINT32_MAX, &ack, pdMS_TO_TICKS(2 * NAV_SYNC_TIMEOUT_MS)) || ack != CARD_ACK_OK) {
+                ESP_LOGW(TAG, "SD release not confirmed, retrying");
+                continue;
+            }
+            card_detach();
+        } else {
+#if SD_PIN_CD >= 0
+            if (gpio_get_level(SD_PIN_CD) != 0) continue;   // slot empty
+#endif
+            int64_t t0 = esp_timer_get_time();
+            xSemaphoreTake(card_lock, portMAX_DELAY);
+            bool ok = booting ? init_sd() : noor_card_mount(&card_cfg, &sdcard) == ESP_OK;
+            if (ok) {
+                card_mounted = true;
+                card_attach();
+            }
+            xSemaphoreGive(card_lock);
+            if (booting && !ok) ESP_LOGE(TAG, "SD init failed - check wiring/card (retrying every %d ms)", SD_POLL_MS);
+            booting = false;
+            if (!ok) continue;
+            ESP_LOGI(TAG, "SD card attached (%lld ms)", (long long)((esp_timer_get_time() - t0) / 1000));
+            while (!card_post(1)) {}   // nav_task must hear about it, or the card would sit unused
+        }
+    }
+}
+
+static bool card_watch_init(void) {
+    return xTaskCreatePinnedToCore(card_task, "card_task", 4096, NULL, CARD_TASK_PRIO, &card_task_handle, TASK_CORE(CARD_TASK_CORE)) == pdPASS;
+}
+
 /* ---------- GPIO init ---------- */
 static void init_inputs(void) {
     gpio_config_t io_conf = {
@@ -232,478 +700,612 @@ static void init_inputs(void) {
     ESP_LOGI(TAG, "Inputs configured (buttons + encoder)");
 }
 
-/* ---------- Buttons ---------- */
-typedef struct { gpio_num_t gpio; const char *name; uint32_t last_time; bool last_state; } btn_t;
-static btn_t btn_play = { BTN_PLAY_PAUSE_PIN, "Play/Pause", 0, false };
-static btn_t btn_home = { BTN_HOME_PIN, "Home", 0, false };
-static btn_t btn_volp = { BTN_VOL_UP_PIN, "Vol+", 0, false };
-static btn_t btn_volm = { BTN_VOL_DOWN_PIN, "Vol-", 0, false };
-
-static bool read_button_press(btn_t *b) {
-    bool lvl = gpio_get_level(b->gpio);
-    uint32_t t = xTaskGetTickCount() * portTICK_PERIOD_MS;
-    if (lvl && !b->last_state) {
-        if (t - b->last_time > DEBOUNCE_MS) {
-            b->last_time = t;
-            b->last_state = lvl;
-            return true;
-        }
+/* ---------- Buttons (level ISR + esp_timer debounce) ---------- */
+// Each pin interrupts on the level opposite to its settled state, which is also its light-sleep
+// wake source. A press is queued from the first interrupt, then the pin's interrupt stays off for
+// DEBOUNCE_MS; the timer samples the settled level and arms the opposite one, so release bounce
+// never looks like a new press and nothing polls between events.
+typedef enum { BTN_ID_PLAY = 0, BTN_ID_HOME, BTN_ID_VOLP, BTN_ID_VOLM, BTN_ID_ENC_SW, BTN_COUNT } btn_id_t;
+typedef struct {
+    gpio_num_t gpio;
+    const char *name;
+    esp_timer_handle_t timer;
+    volatile bool down;     // settled level after the last debounce
+} btn_t;
+static btn_t buttons[BTN_COUNT] = {
+    [BTN_ID_PLAY]   = { .gpio = BTN_PLAY_PAUSE_PIN, .name = "Play/Pause" },
+    [BTN_ID_HOME]   = { .gpio = BTN_HOME_PIN,       .name = "Home" },
+    [BTN_ID_VOLP]   = { .gpio = BTN_VOL_UP_PIN,     .name = "Vol+" },
+    [BTN_ID_VOLM]   = { .gpio = BTN_VOL_DOWN_PIN,   .name = "Vol-" },
+    [BTN_ID_ENC_SW] = { .gpio = ENC_SW_PIN,         .name = "Encoder SW" },
+};
+
+static void IRAM_ATTR gpio_isr_btn_handler(void *arg) {
+    btn_t *b = (btn_t *)arg;
+    gpio_intr_disable(b->gpio);   // level interrupt: off until the debounce timer re-arms it
+    BaseType_t hp = pdFALSE;
+    if (!b->down) {   // armed on the high level: this is a press
+        input_evt_t ev = { .type = EVT_BUTTON, .arg = (int16_t)(b - buttons) };
+        xQueueSendFromISR(input_queue, &ev, &hp);
     }
-    b->last_state = lvl;
-    return false;
+    esp_timer_start_once(b->timer, DEBOUNCE_MS * 1000);
+    if (hp == pdTRUE) portYIELD_FROM_ISR();
 }
 
-/* ---------- WAV header parsing ---------- */
-typedef struct {
-    uint32_t sample_rate;
-    uint16_t bits_per_sample;
-    uint16_t channels;
-    uint32_t data_size;
-    uint32_t data_offset;
-} wav_info_t;
-
-static bool parse_wav_header(FILE *f, wav_info_t *info) {
-    uint8_t header[44];
-    if (fread(header,1,44,f) != 44) return false;
-    if (memcmp(header,"RIFF",4)!=0 || memcmp(header+8,"WAVE",4)!=0) return false;
-    info->channels = *((uint16_t*)(header+22));
-    info->sample_rate = *((uint32_t*)(header+24));
-    info->bits_per_sample = *((uint16_t*)(header+34));
-    info->data_size = *((uint32_t*)(header+40));
-    info->data_offset = 44;
+static void btn_arm(btn_t *b) {
+    b->down = gpio_get_level(b->gpio);
+    gpio_wakeup_enable(b->gpio, b->down ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL);   // sets the interrupt level too
+    gpio_intr_enable(b->gpio);
+}
+
+static void btn_debounce_cb(void *arg) {
+    btn_arm((btn_t *)arg);
+}
+
+// Needs the GPIO ISR service and input_queue.
+static bool buttons_init(void) {
+    for (int i = 0; i < BTN_COUNT; ++i) {
+        btn_t *b = &buttons[i];
+        const esp_timer_create_args_t args = { .callback = btn_debounce_cb, .arg = b, .name = b->name };
+        if (esp_timer_create(&args, &b->timer) != ESP_OK) { ESP_LOGE(TAG, "Failed to create debounce timer for %s", b->name); return false; }
+        gpio_isr_handler_add(b->gpio, gpio_isr_btn_handler, b);
+        btn_arm(b);
+    }
     return true;
 }
 
-/* ---------- Stream file with interruption, pause, and volume support ---------- */
-static bool stream_file_interruptible(const char *fullpath, volatile bool *stop_flag_ptr, volatile bool *pause_flag_ptr) {
-    if (!fullpath) return false;
-    FILE *f = fopen(fullpath, "rb");
-    if (!f) { ESP_LOGW(TAG, "stream_file: not found: %s", fullpath); return false; }
-    wav_info_t winfo;
-    if (!parse_wav_header(f, &winfo)) { ESP_LOGE(TAG, "Invalid WAV header: %s", fullpath); fclose(f); return false; }
-    if (winfo.bits_per_sample != 16) { ESP_LOGE(TAG, "Only 16-bit PCM supported: %s", fullpath); fclose(f); return false; }
-
-    i2s_config_t i2s_cfg = {
-        .mode = I2S_MODE_MASTER | I2S_MODE_TX,
-        .sample_rate = (int)winfo.sample_rate,
-        .bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT,
-        .channel_format = (winfo.channels == 1) ? I2S_CHANNEL_FMT_ONLY_LEFT : I2S_CHANNEL_FMT_RIGHT_LEFT,
-        .communication_format = I2S_COMM_FORMAT_I2S,
-        .intr_alloc_flags = 0,
-        .dma_buf_count = 4,
-        .dma_buf_len = 1024,
-        .use_apll = false,
-        .tx_desc_auto_clear = true
-    };
-    i2s_pin_config_t pin_cfg = { .bck_io_num = I2S_BCK_PIN, .ws_io_num = I2S_WS_PIN, .data_out_num = I2S_DO_PIN, .data_in_num = I2S_PIN_NO_CHANGE };
+/* ---------- Power management (DFS minimum and light sleep when idle) ---------- */
+// The engine is the only thing that needs full clocks and takes them itself while it streams
+// (CPU_FREQ_MAX lock, I2S started). Otherwise nothing holds a lock, so esp_pm drops to min_freq and
+// the idle task light-sleeps until a button/encoder GPIO or a timer wakes it.
+#ifdef CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+static uint64_t pm_sleep_us = 0;   // time actually spent in light sleep
+static uint32_t pm_sleeps = 0;
 
-    esp_err_t r = i2s_driver_install(I2S_NUM_0, &i2s_cfg, 0, NULL);
-    if (r != ESP_OK) { ESP_LOGE(TAG, "i2s_driver_install failed: %s", esp_err_to_name(r)); fclose(f); return false; }
-    r = i2s_set_pin(I2S_NUM_0, &pin_cfg);
-    if (r != ESP_OK) { ESP_LOGE(TAG, "i2s_set_pin failed: %s", esp_err_to_name(r)); i2s_driver_uninstall(I2S_NUM_0); fclose(f); return false; }
-    r = i2s_set_clk(I2S_NUM_0, winfo.sample_rate, I2S_BITS_PER_SAMPLE_16BIT, winfo.channels);
-    if (r != ESP_OK) ESP_LOGW(TAG, "i2s_set_clk: %s", esp_err_to_name(r));
+static esp_err_t IRAM_ATTR pm_sleep_exit_cb(int64_t sleep_time_us, void *arg) {
+    pm_sleep_us += (uint64_t)sleep_time_us;
+    pm_sleeps++;
+    return ESP_OK;
+}
+#endif
 
-    fseek(f, winfo.data_offset, SEEK_SET);
-    const size_t chunk_bytes = 1024 * (winfo.bits_per_sample / 8) * winfo.channels;
-    uint8_t *buf = malloc(chunk_bytes);
-    if (!buf) { ESP_LOGE(TAG, "No mem"); fclose(f); i2s_driver_uninstall(I2S_NUM_0); return false; }
+// Returns false only if esp_pm rejected the configuration.
+static bool pm_init(void) {
+#ifdef CONFIG_NOOR_PM
+    esp_pm_config_t cfg = {
+        .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = CONFIG_NOOR_PM_MIN_MHZ,
+#ifdef CONFIG_NOOR_PM_LIGHT_SLEEP
+        .light_sleep_enable = true,
+#endif
+    };
+    esp_err_t r = esp_pm_configure(&cfg);
+    if (r != ESP_OK) { ESP_LOGW(TAG, "esp_pm_configure: %s (running at full clock)", esp_err_to_name(r)); return false; }
+#ifdef CONFIG_NOOR_PM_LIGHT_SLEEP
+    esp_sleep_enable_gpio_wakeup();
+#ifdef CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+    esp_pm_sleep_cbs_register_config_t cbs = { .exit_cb = pm_sleep_exit_cb };
+    esp_pm_light_sleep_register_cbs(&cbs);
+#endif
+#endif
+    ESP_LOGI(TAG, "pm: DFS %d..%d MHz, light sleep %s", CONFIG_NOOR_PM_MIN_MHZ, CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ, cfg.light_sleep_enable ? "on" : "off");
+#endif
+    return true;
+}
 
-    while (1) {
-        // Check stop flag first
-        if (stop_flag_ptr && *stop_flag_ptr) {
-            ESP_LOGI(TAG, "stream interrupted by stop flag: %s", fullpath);
-            break;
-        }
-        // Pause handling
-        if (pause_flag_ptr && *pause_flag_ptr) {
-            vTaskDelay(pdMS_TO_TICKS(50));
-            continue;
-        }
+/* ---------- Engine callbacks (run on the noor_audio engine task) ---------- */
+// Published entries never change before the next STOP barrier, so only the length check needs list_lock.
+static bool engine_track(int idx, noor_source_t *out, void *ctx) {
+    xSemaphoreTake(list_lock, portMAX_DELAY);
+    bool ok = idx >= 0 && idx < num_tracks;
+    xSemaphoreGive(list_lock);
+    if (ok) *out = (noor_source_t){ .path = wav_list[idx], .meta = &wav_meta[idx] };
+    return ok;
+}
 
-        size_t bytes_read = fread(buf, 1, chunk_bytes, f);
-        if (bytes_read == 0) break;
-
-        // apply volume scaling (16-bit PCM)
-        if (g_volume_percent != 100) {
-            int16_t *samps = (int16_t*)buf;
-            size_t ns = bytes_read / sizeof(int16_t);
-            int vol = g_volume_percent; // read once to avoid concurrent read tearing
-            for (size_t i=0;i<ns;++i) {
-                int32_t scaled = ((int32_t)samps[i] * vol) / 100;
-                samps[i] = clip16(scaled);
-            }
-        }
+static const char *engine_clip(int id, void *ctx) {
+    return ann_path((ann_id_t)id);
+}
 
-        size_t written = 0;
-        esp_err_t res = i2s_write(I2S_NUM_0, buf, bytes_read, &written, pdMS_TO_TICKS(1000));
-        if (res != ESP_OK) ESP_LOGW(TAG, "i2s_write: %s", esp_err_to_name(res));
-        // small yield so other tasks/ISRs run
-        vTaskDelay(pdMS_TO_TICKS(1));
-    }
+static void engine_playback(int track, void *ctx) {
+    nav_post_playback(track);
+}
 
-    free(buf);
-    fclose(f);
-    i2s_driver_uninstall(I2S_NUM_0);
-    return true;
+/* ---------- UI requests (post commands to the audio engine) ---------- */
+static void request_announcement_id(ann_id_t id) {
+    if (id != ANN_NONE) noor_audio_announce(id);
 }
 
-/* ---------- Announcement setter (copy path + notify audio task) ---------- */
-static void request_announcement(const char *path) {
-    if (!path) return;
-    strncpy(announce_path, path, sizeof(announce_path)-1);
-    announce_path[sizeof(announce_path)-1] = '\0';
-    // interrupt any current playback/announcement
-    stop_flag = true;
-    if (audio_task_handle) {
-        xTaskNotify(audio_task_handle, NOTIFY_ANNOUNCE_BIT, eSetBits);
+// Play/Pause on a track: start it, toggle pause if it is the one playing, or switch to it.
+static void request_play_pause(int track, const char *who) {
+    if (track < 0 || track >= num_tracks) { ESP_LOGI(TAG, "No tracks to play"); return; }
+    if (noor_audio_is_playing() && noor_audio_playing_track() == track) {
+        noor_audio_pause(-1);
+        ESP_LOGI(TAG, "%s: toggle pause", who);
+    } else {
+        noor_audio_play(track);
+        ESP_LOGI(TAG, "%s: request play %d", who, track);
     }
 }
 
-/* ---------- Encoder ISRs (IRAM safe) ---------- */
-static void IRAM_ATTR gpio_isr_clk_handler(void *arg) {
-    uint32_t dt_level = gpio_get_level(ENC_DT_PIN);
-    enc_evt_t ev = { .type = ENC_EVT_CLK, .dt_level = (uint8_t)dt_level };
+/* ---------- Encoder (PCNT quadrature decoder) ---------- */
+// Both encoder lines feed one PCNT unit in x4 mode, behind the hardware glitch filter, so every edge
+// is counted without CPU work. The first detent of a gesture trips a watch point that wakes
+// nav_task; it then reads deltas every ENC_POLL_MS while the knob moves and goes back to waiting
+// on the watch point once it has been still for ENC_IDLE_MS.
+static pcnt_unit_handle_t enc_unit = NULL;
+
+static bool IRAM_ATTR enc_pcnt_on_reach(pcnt_unit_handle_t unit, const pcnt_watch_event_data_t *edata, void *user_ctx) {
+    input_evt_t ev = { .type = EVT_ENC_MOVE, .arg = 0 };
     BaseType_t hp = pdFALSE;
-    xQueueSendFromISR(enc_queue, &ev, &hp);
-    if (hp == pdTRUE) portYIELD_FROM_ISR();
+    xQueueSendFromISR(input_queue, &ev, &hp);
+    return hp == pdTRUE;
 }
-static void IRAM_ATTR gpio_isr_sw_handler(void *arg) {
-    enc_evt_t ev = { .type = ENC_EVT_SW, .dt_level = 0 };
+
+#ifdef CONFIG_NOOR_PM_LIGHT_SLEEP
+// PCNT is not clocked in light sleep, so CLK also gets a one-shot level interrupt (and wake source)
+// on the level opposite to where it rests; encoder_rearm() arms it again once the knob is still.
+static void IRAM_ATTR gpio_isr_enc_wake(void *arg) {
+    gpio_intr_disable(ENC_CLK_PIN);
+    input_evt_t ev = { .type = EVT_ENC_MOVE, .arg = 0 };
     BaseType_t hp = pdFALSE;
-    xQueueSendFromISR(enc_queue, &ev, &hp);
+    xQueueSendFromISR(input_queue, &ev, &hp);
     if (hp == pdTRUE) portYIELD_FROM_ISR();
 }
+#endif
+
+static void encoder_rearm(int *pos) {
+    if (enc_unit) pcnt_unit_clear_count(enc_unit);
+    *pos = 0;
+#ifdef CONFIG_NOOR_PM_LIGHT_SLEEP
+    gpio_wakeup_enable(ENC_CLK_PIN, gpio_get_level(ENC_CLK_PIN) ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL);
+    gpio_intr_enable(ENC_CLK_PIN);
+#endif
+}
+
+// Needs input_queue.
+static bool encoder_init(void) {
+    pcnt_unit_config_t unit_cfg = { .low_limit = -ENC_PCNT_LIMIT, .high_limit = ENC_PCNT_LIMIT, .flags.accum_count = 1 };
+    if (pcnt_new_unit(&unit_cfg, &enc_unit) != ESP_OK) { ESP_LOGE(TAG, "Failed to create PCNT unit"); return false; }
+    pcnt_glitch_filter_config_t filter = { .max_glitch_ns = ENC_GLITCH_NS };
+    pcnt_unit_set_glitch_filter(enc_unit, &filter);
+    pcnt_chan_config_t a_cfg = { .edge_gpio_num = ENC_CLK_PIN, .level_gpio_num = ENC_DT_PIN };
+    pcnt_chan_config_t b_cfg = { .edge_gpio_num = ENC_DT_PIN, .level_gpio_num = ENC_CLK_PIN };
+    pcnt_channel_handle_t ch_a = NULL, ch_b = NULL;
+    if (pcnt_new_channel(enc_unit, &a_cfg, &ch_a) != ESP_OK || pcnt_new_channel(enc_unit, &b_cfg, &ch_b) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create PCNT channels");
+        return false;
+    }
+    // CLK rising while DT is low counts up, which is "next" (same direction as the old CLK ISR)
+    pcnt_channel_set_edge_action(ch_a, PCNT_CHANNEL_EDGE_ACTION_DECREASE, PCNT_CHANNEL_EDGE_ACTION_INCREASE);
+    pcnt_channel_set_level_action(ch_a, PCNT_CHANNEL_LEVEL_ACTION_KEEP, PCNT_CHANNEL_LEVEL_ACTION_INVERSE);
+    pcnt_channel_set_edge_action(ch_b, PCNT_CHANNEL_EDGE_ACTION_INCREASE, PCNT_CHANNEL_EDGE_ACTION_DECREASE);
+    pcnt_channel_set_level_action(ch_b, PCNT_CHANNEL_LEVEL_ACTION_KEEP, PCNT_CHANNEL_LEVEL_ACTION_INVERSE);
+    // limits keep accum_count exact on overflow; the detent points wake nav_task on the first step
+    const int points[] = { -ENC_PCNT_LIMIT, -ENC_COUNTS_PER_DETENT, ENC_COUNTS_PER_DETENT, ENC_PCNT_LIMIT };
+    for (int i = 0; i < 4; ++i) pcnt_unit_add_watch_point(enc_unit, points[i]);
+    pcnt_event_callbacks_t cbs = { .on_reach = enc_pcnt_on_reach };
+    pcnt_unit_register_event_callbacks(enc_unit, &cbs, NULL);
+    pcnt_unit_enable(enc_unit);
+    pcnt_unit_start(enc_unit);
+#ifdef CONFIG_NOOR_PM_LIGHT_SLEEP
+    gpio_isr_handler_add(ENC_CLK_PIN, gpio_isr_enc_wake, NULL);
+#endif
+    int pos;
+    encoder_rearm(&pos);
+    return true;
+}
+
+// Whole detents turned since the last call; the sub-detent remainder is kept for next time.
+static int encoder_take_detents(int *pos) {
+    int count = 0;
+    if (!enc_unit || pcnt_unit_get_count(enc_unit, &count) != ESP_OK) return 0;
+    int detents = (count - *pos) / ENC_COUNTS_PER_DETENT;
+    *pos += detents * ENC_COUNTS_PER_DETENT;
+    return detents;
+}
+
+// Detents -> list steps: slow turns move one entry per detent, fast spins up to ENC_ACCEL_FAST_MUL.
+static int encoder_accelerate(int detents, uint32_t dt_ms) {
+    uint32_t dps = (uint32_t)abs(detents) * 1000u / (dt_ms ? dt_ms : 1);
+    int mul = (dps >= ENC_ACCEL_FAST_DPS) ? ENC_ACCEL_FAST_MUL : (dps >= ENC_ACCEL_MED_DPS) ? ENC_ACCEL_MED_MUL : 1;
+    return detents * mul;
+}
+
+// Single steps wrap around like before; accelerated steps stop at the ends of the list.
+static int list_step(int cur, int steps, int n) {
+    if (n <= 0) return 0;
+    if (steps == 1 || steps == -1) return (cur + steps + n) % n;
+    int next = cur + steps;
+    return next < 0 ? 0 : next >= n ? n - 1 : next;
+}
+
+/* ---------- Navigation core (nav_task) ---------- */
+// nav_task is the only consumer of input_queue and the only writer of nav_state, the selection and
+// the folder/track lists. Button and encoder ISRs post input events, audio_task posts playback
+// events; each becomes a nav input and nav_table[state][input] decides what happens. Volume does the
+// same in every state and is handled before the table. Before clearing the track list for a new
+// folder, nav_task stops the engine and waits for it to confirm, so audio_task never reads a list
+// entry that is being replaced; scan results are then appended as they arrive.
+typedef enum { NAV_IN_SELECT = 0, NAV_IN_BACK, NAV_IN_TURN, NAV_IN_PLAYBACK, NAV_IN_COUNT } nav_input_t;
+typedef nav_state_t (*nav_action_fn)(int arg);   // returns the next state
+
+static TaskHandle_t nav_task_handle = NULL;
+static int ui_volume = 100;   // requested level; the engine ramps to it
+
+// STOP barrier: every command posted before it has been handled and the engine is idle.
+static void engine_release_lists(void) {
+    if (!noor_audio_stop_sync(NAV_SYNC_TIMEOUT_MS)) ESP_LOGW(TAG, "engine did not confirm STOP; rescanning anyway");
+}
+
+// Empty the track list (engine already stopped) and hand folder to scan_task.
+static void nav_scan_start(const char *folder) {
+    xSemaphoreTake(list_lock, portMAX_DELAY);
+    num_tracks = 0;
+    ann_clear_tracks();
+    xSemaphoreGive(list_lock);
+    current_track = 0;
+    scan_req_t req = { .path = folder, .gen = atomic_fetch_add(&scan_gen, 1) + 1 };
+    xQueueOverwrite(scan_req_q, &req);
+}
+
+// Append one published track. The first one is announced at once if the folder is still open.
+static void nav_scan_result(const scan_result_t *r) {
+    if (num_tracks >= MAX_WAV_FILES) return;
+    xSemaphoreTake(list_lock, portMAX_DELAY);
+    int i = num_tracks;
+    wav_list[i] = r->path;
+    wav_meta[i] = r->info;
+    ann_track_added(i);
+    num_tracks = i + 1;
+    xSemaphoreGive(list_lock);
+    if (i == 0 && nav_state == NAV_FILE_VIEW) {
+        ESP_LOGI(TAG, "File selected: 0 -> %s (%u ms)", wav_list[0], (unsigned)wav_meta[0].duration_ms);
+        // announce current selection inside folder (S1) if pattern matches
+        request_announcement_id(ann_for_track(0));
+    }
+}
+
+static void nav_scan_drain(void) {
+    scan_result_t r;
+    while (xQueueReceive(scan_res_q, &r, 0) == pdTRUE) {
+        if (r.gen == atomic_load(&scan_gen)) nav_scan_result(&r);   // older generations: folder already left
+    }
+}
+
+static nav_state_t nav_open_folders(int arg) {
+    if (num_folders <= 0) { ESP_LOGI(TAG, "No folders to enter"); return NAV_HOME; }
+    ESP_LOGI(TAG, "HOME -> FOLDER_VIEW (selected=%d)", selected_folder);
+    return NAV_FOLDER_VIEW;
+}
+
+static nav_state_t nav_turn_folders(int steps) {
+    if (num_folders > 0) {
+        selected_folder = list_step(selected_folder, steps, num_folders);
+        ESP_LOGI(TAG, "Folder selected: %d -> %s", selected_folder, folder_list[selected_folder]);
+        // if folder is stories/01, announce it immediately
+        request_announcement_id(ann_for_folder(selected_folder));
+    }
+    return nav_state;
+}
+
+static nav_state_t nav_enter_folder(int arg) {
+    if (num_folders <= 0) return NAV_FOLDER_VIEW;
+    const char *folder_path = folder_list[selected_folder];
+    engine_release_lists();
+    // If "stories"/"01", announce before entering
+    request_announcement_id(ann_for_folder(selected_folder));
+    nav_scan_start(folder_path);
+    ESP_LOGI(TAG, "Entered folder %s (scanning)", folder_path);
+    return NAV_FILE_VIEW;
+}
+
+static nav_state_t nav_go_home(int arg) {
+    ESP_LOGI(TAG, "FOLDER_VIEW -> HOME");
+    // play home.wav when we get to HOME (announcement)
+    request_announcement_id(ann_home);
+    return NAV_HOME;
+}
+
+static nav_state_t nav_stay_home(int arg) {
+    ESP_LOGI(TAG, "Already at HOME");
+    return NAV_HOME;
+}
+
+static nav_state_t nav_turn_tracks(int steps) {
+    if (num_tracks > 0) {
+        current_track = list_step(current_track, steps, num_tracks);
+        ESP_LOGI(TAG, "File selected: %d -> %s (%u ms)", current_track, wav_list[current_track], (unsigned)wav_meta[current_track].duration_ms);
+        // if file name is S<number>.wav, request storyN announcement
+        request_announcement_id(ann_for_track(current_track));
+    }
+    return NAV_FILE_VIEW;
+}
+
+static nav_state_t nav_play_pause(int arg) {
+    request_play_pause(current_track, "Select");
+    return NAV_FILE_VIEW;
+}
+
+// The list stays until the next folder is entered; that scan waits for the engine first.
+// A scan still running for this folder is cancelled.
+static nav_state_t nav_leave_folder(int arg) {
+    atomic_fetch_add(&scan_gen, 1);
+    if (noor_audio_is_playing()) noor_audio_stop();
+    ESP_LOGI(TAG, "FILE_VIEW -> FOLDER_VIEW");
+    return NAV_FOLDER_VIEW;
+}
+
+// Selection follows playback (auto-advance moved on to track arg; -1 = playback ended).
+static nav_state_t nav_follow_playback(int track) {
+    if (track >= 0 && track < num_tracks && track != current_track) {
+        current_track = track;
+        ESP_LOGI(TAG, "Selection follows playback: %d -> %s", track, wav_list[track]);
+    }
+    return NAV_FILE_VIEW;
+}
+
+// welcome.wav, then home.wav once it has finished; any input cuts them short. The root clips follow
+// into the announcement cache while the engine is idle.
+static void nav_greet(void) {
+    if (ann_welcome != ANN_NONE) noor_audio_announce(ann_welcome);
+    if (ann_home != ANN_NONE) noor_audio_announce_next(ann_home);
+    for (int i = 0; i < ann_track_base; ++i) noor_audio_cache(i);   // root and folder clips
+}
+
+// Card gone (mounted == 0): cancel the scan, have the engine close its files and forget its clips,
+// and empty every list before card_task unmounts. Card there (at boot, or back after a swap): list
+// the root from the catalog card_task loaded and greet.
+static void nav_card(int mounted) {
+    if (!mounted) {
+        atomic_fetch_add(&scan_gen, 1);
+        bool ok = noor_audio_release_files(NAV_SYNC_TIMEOUT_MS);
+        xSemaphoreTake(list_lock, portMAX_DELAY);
+        num_tracks = 0;
+        ann_clear_all();
+        xSemaphoreGive(list_lock);
+        free_folder_list();
+        current_track = 0;
+        nav_state = NAV_HOME;
+        ESP_LOGI(TAG, "Card gone -> HOME, lists cleared%s", ok ? "" : " (engine did not confirm)");
+        if (card_task_handle) xTaskNotify(card_task_handle, ok ? CARD_ACK_OK : CARD_ACK_BUSY, eSetValueWithOverwrite);
+        return;
+    }
+    scan_root_folders(SD_MOUNT_POINT);
+    select_default_folder();
+    nav_state = NAV_HOME;
+    nav_greet();
+    ESP_LOGI(TAG, "Card ready: %d folders at %lld ms", num_folders, (long long)(esp_timer_get_time() / 1000));
+}
+
+static const nav_action_fn nav_table[NAV_STATE_COUNT][NAV_IN_COUNT] = {
+    [NAV_HOME]        = { [NAV_IN_SELECT] = nav_open_folders, [NAV_IN_BACK] = nav_stay_home,    [NAV_IN_TURN] = nav_turn_folders },
+    [NAV_FOLDER_VIEW] = { [NAV_IN_SELECT] = nav_enter_folder, [NAV_IN_BACK] = nav_go_home,      [NAV_IN_TURN] = nav_turn_folders },
+    [NAV_FILE_VIEW]   = { [NAV_IN_SELECT] = nav_play_pause,   [NAV_IN_BACK] = nav_leave_folder, [NAV_IN_TURN] = nav_turn_tracks,
+                          [NAV_IN_PLAYBACK] = nav_follow_playback },
+};
+
+static void nav_dispatch(nav_input_t in, int arg) {
+    nav_action_fn fn = nav_table[nav_state][in];
+    if (fn) nav_state = fn(arg);
+}
+
+static void nav_set_volume(int delta) {
+    ui_volume += delta;
+    if (ui_volume > 200) ui_volume = 200;
+    if (ui_volume < 0) ui_volume = 0;
+    noor_audio_set_gain(ui_volume);
+    ESP_LOGI(TAG, "Volume -> %d%%", ui_volume);
+}
+
+static void nav_button(btn_id_t id) {
+    ESP_LOGI(TAG, "%s pressed (nav=%d)", buttons[id].name, nav_state);
+    switch (id) {
+    case BTN_ID_PLAY:
+    case BTN_ID_ENC_SW: nav_dispatch(NAV_IN_SELECT, 0); break;   // encoder SW behaves like Play/Pause
+    case BTN_ID_HOME:   nav_dispatch(NAV_IN_BACK, 0); break;
+    case BTN_ID_VOLP:   nav_set_volume(+10); break;
+    case BTN_ID_VOLM:   nav_set_volume(-10); break;
+    default: break;
+    }
+}
 
-/* ---------- Encoder processing task ---------- */
-static void encoder_task(void *arg) {
-    ESP_LOGI(TAG, "encoder_task started");
-    enc_evt_t ev;
-    uint32_t last_step_time = 0;
-    uint32_t last_sw_time = 0;
+static void nav_task(void *arg) {
+    ESP_LOGI(TAG, "nav_task started");
+    input_evt_t ev;
+    int enc_pos = 0;                 // PCNT count already turned into steps
+    bool enc_active = false;         // knob moving: poll PCNT instead of waiting for the watch point
+    uint32_t enc_last_move = 0;
 
     while (1) {
-        if (xQueueReceive(enc_queue, &ev, portMAX_DELAY) == pdTRUE) {
-            uint32_t now = xTaskGetTickCount() * portTICK_PERIOD_MS;
-            if (ev.type == ENC_EVT_CLK) {
-                if (now - last_step_time < ENC_STEP_DEBOUNCE_MS) continue;
-                last_step_time = now;
-                if (nav_state == NAV_HOME || nav_state == NAV_FOLDER_VIEW) {
-                    if (num_folders > 0) {
-                        if (ev.dt_level == 0) selected_folder = (selected_folder + 1) % num_folders;
-                        else selected_folder = (selected_folder - 1 + num_folders) % num_folders;
-                        ESP_LOGI(TAG, "Folder selected: %d -> %s", selected_folder, folder_list[selected_folder]);
-                        // if folder is stories/01, announce it immediately
-                        const char *fp = folder_list[selected_folder];
-                        const char *name = strrchr(fp, '/'); name = name ? name+1 : fp;
-                        if (strcasecmp(name, "01")==0 || strcasecmp(name, "stories")==0) {
-                            if (access("/sdcard/stories.wav", F_OK) == 0) request_announcement("/sdcard/stories.wav");
-                            else {
-                                char *in_folder = make_path(fp, "stories.wav");
-                                if (in_folder) { if (access(in_folder, F_OK)==0) request_announcement(in_folder); free(in_folder); }
-                            }
-                        }
-                    }
-                } else if (nav_state == NAV_FILE_VIEW) {
-                    if (num_tracks > 0) {
-                        if (ev.dt_level == 0) current_track = (current_track + 1) % num_tracks;
-                        else current_track = (current_track - 1 + num_tracks) % num_tracks;
-                        ESP_LOGI(TAG, "File selected: %d -> %s", current_track, wav_list[current_track]);
-                        // if file name is S<number>.wav, request storyN announcement
-                        const char *fullname = wav_list[current_track];
-                        const char *b = strrchr(fullname, '/'); b = b ? b+1 : fullname;
-                        if ((b[0]=='S' || b[0]=='s') && isdigit((unsigned char)b[1])) {
-                            int n = b[1] - '0';
-                            char candidate_root[ANNOUNCE_PATH_MAX];
-                            snprintf(candidate_root, sizeof(candidate_root), "/sdcard/story%d.wav", n);
-                            if (access(candidate_root, F_OK) == 0) request_announcement(candidate_root);
-                            else {
-                                const char *slash = strrchr(fullname, '/');
-                                if (slash) {
-                                    size_t folder_len = slash - fullname;
-                                    if (folder_len < ANNOUNCE_PATH_MAX) {
-                                        char folder_dir[ANNOUNCE_PATH_MAX];
-                                        memcpy(folder_dir, fullname, folder_len);
-                                        folder_dir[folder_len] = '\0';
-                                        char storyname[32];
-                                        snprintf(storyname, sizeof(storyname), "story%d.wav", n);
-                                        char *candidate2 = make_path(folder_dir, storyname);
-                                        if (candidate2) { if (access(candidate2, F_OK)==0) request_announcement(candidate2); free(candidate2); }
-                                    }
-                                }
-                            }
-                        }
-                    }
-                }
-            } else if (ev.type == ENC_EVT_SW) {
-                if (now - last_sw_time < DEBOUNCE_MS) continue;
-                last_sw_time = now;
-                // behave like Play/Pause press
-                if (nav_state == NAV_FILE_VIEW) {
-                    if (!g_playing) {
-                        if (num_tracks > 0) {
-                            // request immediate interrupt and play selected track
-                            playing_track = current_track;
-                            g_playing = true; g_pause = false;
-                            // Interrupt current streaming
-                            stop_flag = true;
-                            if (audio_task_handle) xTaskNotify(audio_task_handle, (uint32_t)(current_track + 1), eSetValueWithOverwrite);
-                            ESP_LOGI(TAG, "Encoder SW: request play %d", current_track);
-                        }
-                    } else {
-                        if (playing_track == current_track) {
-                            g_pause = !g_pause;
-                            ESP_LOGI(TAG, "Encoder SW: toggle pause -> %s", g_pause ? "PAUSED":"PLAYING");
-                        } else {
-                            // switch to a different track
-                            playing_track = current_track; g_pause = false;
-                            stop_flag = true;
-                            if (audio_task_handle) xTaskNotify(audio_task_handle, (uint32_t)(current_track + 1), eSetValueWithOverwrite);
-                            ESP_LOGI(TAG, "Encoder SW: switch to %d", current_track);
-                        }
-                    }
-                } else if (nav_state == NAV_FOLDER_VIEW) {
-                    if (num_folders > 0) {
-                        const char *folder_path = folder_list[selected_folder];
-                        const char *name = strrchr(folder_path, '/'); name = name ? name+1 : folder_path;
-                        if (strcasecmp(name,"01")==0 || strcasecmp(name,"stories")==0) {
-                            if (access("/sdcard/stories.wav", F_OK)==0) request_announcement("/sdcard/stories.wav");
-                            else {
-                                char *in_folder = make_path(folder_path, "stories.wav");
-                                if (in_folder) { if (access(in_folder,F_OK)==0) request_announcement(in_folder); free(in_folder); }
-                            }
-                        }
-                        scan_wavs_in_folder(folder_path);
-                        nav_state = NAV_FILE_VIEW; current_track = 0; playing_track = -1; g_playing = false; g_pause = false;
-                        ESP_LOGI(TAG, "Entered folder via encoder SW: %s (files=%d)", folder_path, num_tracks);
-                        // announce current selection inside folder (S1) if pattern matches
-                        if (num_tracks > 0) {
-                            const char *b = strrchr(wav_list[current_track], '/'); b = b ? b+1 : wav_list[current_track];
-                            if ((b[0]=='S' || b[0]=='s') && isdigit((unsigned char)b[1])) {
-                                int n = b[1]-'0';
-                                char candidate_root[ANNOUNCE_PATH_MAX];
-                                snprintf(candidate_root, sizeof(candidate_root), "/sdcard/story%d.wav", n);
-                                if (access(candidate_root,F_OK)==0) request_announcement(candidate_root);
-                                else {
-                                    const char *slash = strrchr(wav_list[current_track], '/');
-                                    if (slash) {
-                                        size_t folder_len = slash - wav_list[current_track];
-                                        if (folder_len < ANNOUNCE_PATH_MAX) {
-                                            char folder_dir[ANNOUNCE_PATH_MAX];
-                                            memcpy(folder_dir, wav_list[current_track], folder_len);
-                                            folder_dir[folder_len] = '\0';
-                                            char storyname[32];
-                                            snprintf(storyname, sizeof(storyname), "story%d.wav", n);
-                                            char *candidate_in = make_path(folder_dir, storyname);
-                                            if (candidate_in) { if (access(candidate_in,F_OK)==0) request_announcement(candidate_in); free(candidate_in); }
-                                        }
-                                    }
-                                }
-                            }
-                        }
-                    }
-                } else if (nav_state == NAV_HOME) {
-                    if (num_folders > 0) { nav_state = NAV_FOLDER_VIEW; ESP_LOGI(TAG, "HOME -> FOLDER_VIEW via encoder SW"); }
-                }
+        bool got = xQueueReceive(input_queue, &ev, enc_active ? pdMS_TO_TICKS(ENC_POLL_MS) : portMAX_DELAY) == pdTRUE;
+        uint32_t now = xTaskGetTickCount() * portTICK_PERIOD_MS;
+        if (enc_active || (got && ev.type == EVT_ENC_MOVE)) {
+            int detents = encoder_take_detents(&enc_pos);
+            if (detents) {
+                nav_dispatch(NAV_IN_TURN, encoder_accelerate(detents, enc_active ? now - enc_last_move : UINT32_MAX));
+                enc_last_move = now;
+                enc_active = true;
+            } else if (!enc_active) {
+                enc_active = true;   // woken by CLK before a whole detent: watch until the knob settles
+                enc_last_move = now;
+            } else if (now - enc_last_move >= ENC_IDLE_MS) {
+                encoder_rearm(&enc_pos);   // drop the partial detent and sleep until the next watch point
+                enc_active = false;
             }
         }
+        nav_scan_drain();
+        if (!got) continue;
+        if (ev.type == EVT_BUTTON && ev.arg >= 0 && ev.arg < BTN_COUNT) nav_button((btn_id_t)ev.arg);
+        else if (ev.type == EVT_PLAYBACK) nav_dispatch(NAV_IN_PLAYBACK, ev.arg);
+        else if (ev.type == EVT_CARD) nav_card(ev.arg);
     }
 }
 
-/* ---------- Audio task using notifications (fixed logic) ---------- */
-static void audio_task(void *arg) {
-    ESP_LOGI(TAG, "audio_task started (waiting for notifications)");
+/* ---------- Deferred log output (log_task) ---------- */
+#if CONFIG_NOOR_LOG_DEFERRED
+// esp_log hands every line to log_vprintf, which formats it on the caller's stack and copies it into
+// a byte ring (esp_ringbuf takes any number of writers). Only log_task waits for the console, so a
+// log call on the audio or storage path never blocks on the UART. A line that finds the ring full
+// is dropped rather than waited for; log_task reports the count after the next line it prints.
+static RingbufHandle_t log_rb = NULL;
+static atomic_uint log_dropped;
+
+static int log_vprintf(const char *fmt, va_list ap) {
+    char line[LOG_LINE_MAX];
+    int n = vsnprintf(line, sizeof(line), fmt, ap);
+    if (n <= 0) return n;
+    size_t len = (size_t)n;
+    if (len >= sizeof(line)) { len = sizeof(line) - 1; line[len - 1] = '\n'; }   // cut, but keep the line break
+    if (xRingbufferSend(log_rb, line, len, 0) != pdTRUE) atomic_fetch_add(&log_dropped, 1);
+    return n;
+}
+
+static void log_task(void *arg) {
+    unsigned reported = 0;
     while (1) {
-        uint32_t val = 0;
-        // Wait for notify; notification might be announce-bit or numeric payload
-        xTaskNotifyWait(0, 0xFFFFFFFF, &val, portMAX_DELAY);
-
-        // If ANNOUNCE bit set -> play announcement
-        if (val & NOTIFY_ANNOUNCE_BIT) {
-            char local_ann[ANNOUNCE_PATH_MAX];
-            strncpy(local_ann, announce_path, sizeof(local_ann)-1);
-            local_ann[sizeof(local_ann)-1] = '\0';
-            // clear stop flag so announcement can run (stop_flag was set before notify to interrupt previous)
-            stop_flag = false;
-            ESP_LOGI(TAG, "Playing announcement (from notify): %s", local_ann);
-            stream_file_interruptible(local_ann, (volatile bool *)&stop_flag, NULL);
-            // after announcement finishes (or is interrupted), continue loop to wait for next notify
-            continue;
-        }
+        size_t len = 0;
+        char *p = xRingbufferReceiveUpTo(log_rb, &len, portMAX_DELAY, LOG_LINE_MAX);
+        if (!p) continue;
+        fwrite(p, 1, len, stdout);
+        vRingbufferReturnItem(log_rb, p);
+        unsigned dropped = atomic_load(&log_dropped);
+        if (dropped != reported) { printf("(%u log lines dropped)\n", dropped - reported); reported = dropped; }
+        fflush(stdout);
+    }
+}
 
-        // If numeric payload -> play that track index (payload == idx+1)
-        if (val != 0) {
-            int idx = (int)val - 1;
-            if (idx < 0 || idx >= num_tracks) {
-                ESP_LOGW(TAG, "Audio_task: invalid play index %d", idx);
-                continue;
-            }
-            // clear stop_flag before starting playback (it was set to true to interrupt previous)
-            stop_flag = false;
-            playing_track = idx;
-            g_playing = true;
-            g_pause = false;
-            ESP_LOGI(TAG, "Audio_task: start playing track %d -> %s", idx, wav_list[idx]);
-            stream_file_interruptible(wav_list[idx], (volatile bool *)&stop_flag, (volatile bool *)&g_pause);
-            // If stop_flag got set (e.g. by an announcement request), the function returned early
-            if (stop_flag) {
-                ESP_LOGI(TAG, "Audio_task: playback interrupted");
-                g_playing = false;
-                playing_track = -1;
-                // The interruptor also sent a notification (announce or other) so it will be handled in the next loop
-                continue;
-            } else {
-                ESP_LOGI(TAG, "Audio_task: playback finished for track %d", idx);
-                g_playing = false;
-                playing_track = -1;
-            }
-        }
+// Lines logged before this go straight to the console, as do panic and early-boot output.
+static bool log_defer_init(void) {
+    log_rb = xRingbufferCreate(LOG_BUF_BYTES, RINGBUF_TYPE_BYTEBUF);
+    if (!log_rb) return false;
+    if (xTaskCreatePinnedToCore(log_task, "log_task", 3072, NULL, LOG_TASK_PRIO, NULL, TASK_CORE(LOG_TASK_CORE)) != pdPASS) {
+        vRingbufferDelete(log_rb);
+        log_rb = NULL;
+        return false;
+    }
+    esp_log_set_vprintf(log_vprintf);
+    return true;
+}
+#endif
+
+/* ---------- Stats console (`stats`, `stats reset`) ---------- */
+#if CONFIG_NOOR_STATS_CONSOLE
+// Priority, core (-1 = either), CPU share since boot (100% = one core) and stack headroom of every task.
+static void stats_print_tasks(void) {
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+    UBaseType_t cap = uxTaskGetNumberOfTasks() + 2;
+    TaskStatus_t *ts = malloc(cap * sizeof(TaskStatus_t));
+    if (!ts) { printf("tasks: out of memory\n"); return; }
+    configRUN_TIME_COUNTER_TYPE total = 0;
+    UBaseType_t n = uxTaskGetSystemState(ts, cap, &total);
+    printf("  %-16s prio core   cpu%%  stack free\n", "task");
+    for (UBaseType_t i = 0; i < n; ++i) {
+        unsigned pm = total ? (unsigned)((uint64_t)ts[i].ulRunTimeCounter * 1000 / total) : 0;
+#if CONFIG_FREERTOS_VTASKLIST_INCLUDE_COREID
+        int core = (ts[i].xCoreID == tskNO_AFFINITY) ? -1 : (int)ts[i].xCoreID;
+#else
+        int core = -1;
+#endif
+        printf("  %-16s %4u %4d %4u.%u %8u\n", ts[i].pcTaskName, (unsigned)ts[i].uxCurrentPriority, core, pm / 10, pm % 10,
+               (unsigned)ts[i].usStackHighWaterMark);
+    }
+    free(ts);
+#else
+    printf("  task list needs CONFIG_FREERTOS_USE_TRACE_FACILITY\n");
+#endif
+}
+
+static void stats_dump(void) {
+    noor_audio_print_stats();
+#ifdef CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+    printf("light sleep: %llu ms in %u sleeps\n", (unsigned long long)(pm_sleep_us / 1000), (unsigned)pm_sleeps);
+#endif
+#if CONFIG_NOOR_LOG_DEFERRED
+    printf("log: %u lines dropped (ring full)\n", (unsigned)atomic_load(&log_dropped));
+#endif
+    printf("tasks:\n");
+    stats_print_tasks();
+    printf("heap: internal %u free (min %u), dma largest %u, psram %u free (min %u)\n",
+           (unsigned)heap_caps_get_free_size(MALLOC_CAP_INTERNAL), (unsigned)heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL),
+           (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_DMA),
+           (unsigned)heap_caps_get_free_size(MALLOC_CAP_SPIRAM), (unsigned)heap_caps_get_minimum_free_size(MALLOC_CAP_SPIRAM));
+}
+
+// Histograms and the trace start over; the engine counters keep running (per-stream deltas use them).
+static int stats_cmd(int argc, char **argv) {
+    if (argc > 1 && !strcmp(argv[1], "reset")) {
+        noor_audio_reset_stats();
+        printf("histograms and trace cleared\n");
+        return 0;
     }
+    stats_dump();
+    return 0;
 }
 
+static void stats_console_init(void) {
+    esp_console_repl_t *repl = NULL;
+    esp_console_repl_config_t repl_cfg = ESP_CONSOLE_REPL_CONFIG_DEFAULT();
+    repl_cfg.prompt = "noor>";
+    repl_cfg.task_core_id = TASK_CORE(LOG_TASK_CORE);   // off the engine's core
+    esp_err_t err = ESP_ERR_NOT_SUPPORTED;
+#if defined(CONFIG_ESP_CONSOLE_UART_DEFAULT) || defined(CONFIG_ESP_CONSOLE_UART_CUSTOM)
+    esp_console_dev_uart_config_t hw = ESP_CONSOLE_DEV_UART_CONFIG_DEFAULT();
+    err = esp_console_new_repl_uart(&hw, &repl_cfg, &repl);
+#elif defined(CONFIG_ESP_CONSOLE_USB_CDC)
+    esp_console_dev_usb_cdc_config_t hw = ESP_CONSOLE_DEV_CDC_CONFIG_DEFAULT();
+    err = esp_console_new_repl_usb_cdc(&hw, &repl_cfg, &repl);
+#elif defined(CONFIG_ESP_CONSOLE_USB_SERIAL_JTAG)
+    esp_console_dev_usb_serial_jtag_config_t hw = ESP_CONSOLE_DEV_USB_SERIAL_JTAG_CONFIG_DEFAULT();
+    err = esp_console_new_repl_usb_serial_jtag(&hw, &repl_cfg, &repl);
+#endif
+    const esp_console_cmd_t cmd = { .command = "stats", .help = "Audio engine latency, underruns, tasks and heap", .hint = "[reset]", .func = stats_cmd };
+    if (err == ESP_OK) err = esp_console_cmd_register(&cmd);
+    if (err == ESP_OK) err = esp_console_start_repl(repl);
+    if (err != ESP_OK) ESP_LOGW(TAG, "stats console unavailable: %s", esp_err_to_name(err));
+}
+#endif
+
 /* ---------- app_main ---------- */
 void app_main(void) {
-    ESP_LOGI(TAG, "=== NAV_PLAYER (FreeRTOS notifications) starting ===");
+#if CONFIG_NOOR_LOG_DEFERRED
+    if (!log_defer_init()) ESP_LOGW(TAG, "Deferred log init failed - logging straight to the console");
+#endif
+    ESP_LOGI(TAG, "=== NAV_PLAYER (command ring) starting ===");
 
     init_inputs();
+    lists_init();
+    pm_init();
+    noor_audio_config_t audio_cfg = {
+        .pin_bck = I2S_BCK_PIN, .pin_ws = I2S_WS_PIN, .pin_dout = I2S_DO_PIN,
+        .track = engine_track, .clip = engine_clip, .on_playback = engine_playback,
+#ifdef CONFIG_NOOR_AUTO_ADVANCE
+        .auto_advance = true,
+#endif
+        .resume = true,
+    };
+    if (!noor_audio_init(&audio_cfg)) ESP_LOGE(TAG, "Audio engine init failed - playback disabled");
 
-    if (!init_sd()) {
-        ESP_LOGE(TAG, "SD init failed - check wiring/card");
-    } else {
-        scan_root_folders("/sdcard");
-        // default selection: prefer "01" -> "audios" -> first
-        if (num_folders > 0) {
-            int found_idx = -1;
-            for (int i=0;i<num_folders;++i) {
-                const char *p = strrchr(folder_list[i], '/'); const char *nameptr = p ? p+1 : folder_list[i];
-                if (strcasecmp(nameptr,"01")==0) { found_idx = i; break; }
-                if (found_idx < 0 && strcasecmp(nameptr,"audios")==0) found_idx = i;
-            }
-            selected_folder = (found_idx >= 0) ? found_idx : 0;
-            ESP_LOGI(TAG, "Default folder selected: index=%d -> %s", selected_folder, folder_list[selected_folder]);
-        } else ESP_LOGW(TAG, "No folders found at /sdcard");
-
-        // Play welcome + home on boot if present (blocking)
-        if (access("/sdcard/welcome.wav", F_OK) == 0) stream_file_interruptible("/sdcard/welcome.wav", NULL, NULL);
-        if (access("/sdcard/home.wav", F_OK) == 0) stream_file_interruptible("/sdcard/home.wav", NULL, NULL);
-        // After boot greetings, we are in HOME
-    }
-
-    // create encoder queue
-    enc_queue = xQueueCreate(ENC_QUEUE_LEN, sizeof(enc_evt_t));
-    if (!enc_queue) ESP_LOGE(TAG, "Failed to create encoder queue");
+    // create input queue; encoder and buttons all feed it from their ISRs
+    input_queue = xQueueCreate(INPUT_QUEUE_LEN, sizeof(input_evt_t));
+    if (!input_queue) ESP_LOGE(TAG, "Failed to create input queue");
     else {
         gpio_install_isr_service(0);
-        gpio_set_intr_type(ENC_CLK_PIN, GPIO_INTR_POSEDGE);
-        gpio_isr_handler_add(ENC_CLK_PIN, gpio_isr_clk_handler, NULL);
-        gpio_set_intr_type(ENC_SW_PIN, GPIO_INTR_POSEDGE);
-        gpio_isr_handler_add(ENC_SW_PIN, gpio_isr_sw_handler, NULL);
-        ESP_LOGI(TAG, "Encoder ISRs installed");
+        if (!buttons_init()) ESP_LOGE(TAG, "Button init failed");
+        if (!encoder_init()) ESP_LOGE(TAG, "Encoder init failed");
+        ESP_LOGI(TAG, "Encoder (PCNT) and button ISRs installed");
     }
 
     // create tasks
-    xTaskCreatePinnedToCore(audio_task, "audio_task", 8192, NULL, 5, &audio_task_handle, tskNO_AFFINITY);
-    xTaskCreatePinnedToCore(encoder_task, "encoder_task", 4096, NULL, 3, NULL, tskNO_AFFINITY);
-
-    // main loop: handle buttons & navigation
-    while (1) {
-        if (read_button_press(&btn_play)) {
-            ESP_LOGI(TAG, "Play/Pause pressed (nav=%d)", nav_state);
-            if (nav_state == NAV_HOME) {
-                if (num_folders > 0) { nav_state = NAV_FOLDER_VIEW; ESP_LOGI(TAG, "HOME -> FOLDER_VIEW (selected=%d)", selected_folder); }
-                else ESP_LOGI(TAG, "No folders to enter");
-            } else if (nav_state == NAV_FOLDER_VIEW) {
-                if (num_folders > 0) {
-                    const char *folder_path = folder_list[selected_folder];
-                    const char *name = strrchr(folder_path, '/'); name = name ? name+1 : folder_path;
-                    // If "stories"/"01", announce before entering
-                    if (strcasecmp(name,"01")==0 || strcasecmp(name,"stories")==0) {
-                        if (access("/sdcard/stories.wav", F_OK) == 0) request_announcement("/sdcard/stories.wav");
-                        else {
-                            char *in_folder = make_path(folder_path, "stories.wav");
-                            if (in_folder) { if (access(in_folder,F_OK)==0) request_announcement(in_folder); free(in_folder); }
-                        }
-                    }
-                    scan_wavs_in_folder(folder_path);
-                    nav_state = NAV_FILE_VIEW;
-                    current_track = 0; playing_track = -1; g_playing = false; g_pause = false;
-                    ESP_LOGI(TAG, "Entered folder %s (files=%d)", folder_path, num_tracks);
-                    // announce current selection inside folder (S1) if pattern matches
-                    if (num_tracks > 0) {
-                        const char *b = strrchr(wav_list[current_track], '/'); b = b ? b+1 : wav_list[current_track];
-                        if ((b[0]=='S' || b[0]=='s') && isdigit((unsigned char)b[1])) {
-                            int n = b[1]-'0';
-                            char candidate_root[ANNOUNCE_PATH_MAX];
-                            snprintf(candidate_root, sizeof(candidate_root), "/sdcard/story%d.wav", n);
-                            if (access(candidate_root, F_OK) == 0) request_announcement(candidate_root);
-                            else {
-                                const char *slash = strrchr(wav_list[current_track], '/');
-                                if (slash) {
-                                    size_t folder_len = slash - wav_list[current_track];
-                                    if (folder_len < ANNOUNCE_PATH_MAX) {
-                                        char folder_dir[ANNOUNCE_PATH_MAX];
-                                        memcpy(folder_dir, wav_list[current_track], folder_len);
-                                        folder_dir[folder_len] = '\0';
-                                        char storyname[32];
-                                        snprintf(storyname, sizeof(storyname), "story%d.wav", n);
-                                        char *cand = make_path(folder_dir, storyname);
-                                        if (cand) { if (access(cand,F_OK)==0) request_announcement(cand); free(cand); }
-                                    }
-                                }
-                            }
-                        }
-                    }
-                }
-            } else if (nav_state == NAV_FILE_VIEW) {
-                if (!g_playing) {
-                    if (num_tracks > 0) {
-                        // start playing selected track using FreeRTOS notification
-                        playing_track = current_track; g_playing = true; g_pause = false;
-                        // Interrupt current streaming
-                        stop_flag = true;
-                        if (audio_task_handle) xTaskNotify(audio_task_handle, (uint32_t)(current_track + 1), eSetValueWithOverwrite);
-                        ESP_LOGI(TAG, "Play button: requested play %d", current_track);
-                    } else ESP_LOGI(TAG, "No tracks to play");
-                } else {
-                    if (playing_track == current_track) {
-                        // toggle pause locally
-                        g_pause = !g_pause;
-                        ESP_LOGI(TAG, "Toggle pause -> %s", g_pause ? "PAUSED":"PLAYING");
-                    } else {
-                        // switch to different track
-                        playing_track = current_track; g_pause = false;
-                        stop_flag = true;
-                        if (audio_task_handle) xTaskNotify(audio_task_handle, (uint32_t)(current_track + 1), eSetValueWithOverwrite);
-                        ESP_LOGI(TAG, "Play button: switch to track %d", current_track);
-                    }
-                }
-            }
-        }
+    xTaskCreatePinnedToCore(nav_task, "nav_task", 4096, NULL, NAV_TASK_PRIO, &nav_task_handle, TASK_CORE(NAV_TASK_CORE));
+    if (!scan_init()) ESP_LOGE(TAG, "Scan task init failed - folders cannot be opened");
+#if CONFIG_NOOR_STATS_CONSOLE
+    stats_console_init();
+#endif
+    ESP_LOGI(TAG, "Interactive at %lld ms (inputs and engine up, card still mounting)", (long long)(esp_timer_get_time() / 1000));
+    // the card comes last: card_task mounts it and nav_task lists the root and greets (EVT_CARD 1)
+    if (!card_watch_init()) ESP_LOGE(TAG, "Card task init failed - no card will be mounted");
 
-        if (read_button_press(&btn_home)) {
-            ESP_LOGI(TAG, "Home pressed (nav=%d)", nav_state);
-            if (nav_state == NAV_FILE_VIEW) {
-                if (g_playing) { g_playing = false; g_pause = false; stop_flag = true; }
-                free_wav_list(); nav_state = NAV_FOLDER_VIEW; ESP_LOGI(TAG, "FILE_VIEW -> FOLDER_VIEW");
-            } else if (nav_state == NAV_FOLDER_VIEW) {
-                nav_state = NAV_HOME;
-                ESP_LOGI(TAG, "FOLDER_VIEW -> HOME");
-                // play home.wav when we get to HOME (announcement)
-                if (access("/sdcard/home.wav", F_OK) == 0) request_announcement("/sdcard/home.wav");
-            } else ESP_LOGI(TAG, "Already at HOME");
-        }
-
-        if (read_button_press(&btn_volp)) {
-            g_volume_percent += 10;
-            if (g_volume_percent > 200) g_volume_percent = 200;
-            ESP_LOGI(TAG, "Vol+ -> %d%%", g_volume_percent);
-        }
-        if (read_button_press(&btn_volm)) {
-            g_volume_percent -= 10;
-            if (g_volume_percent < 0) g_volume_percent = 0;
-            ESP_LOGI(TAG, "Vol- -> %d%%", g_volume_percent);
-        }
-
-        vTaskDelay(pdMS_TO_TICKS(10));
-    }
+    // nothing left to poll: inputs arrive through input_queue, so app_main returns and the idle task can sleep
+    ESP_LOGI(TAG, "Boot complete, input handled by nav_task");
 }
@@ -0,0 +1,162 @@
+// noor_audio.h
+// Noor audio engine: the WAV playback pipeline shared by every firmware variant
+// - I2S is installed once and clocked at NOOR_AUDIO_OUT_RATE stereo; every source is converted to it
+// - 8/16/24/32-bit PCM and IMA-ADPCM WAV through a pluggable decoder stage
+// - A reader task on its own core fills a ring of large SD slots ahead of the I2S writer
+// - Q15 gain with per-chunk ramps; announcements cached in PSRAM and mixed over a ducked story
+// - Optional gapless auto-advance and resume positions batched to NVS
+// - One engine task consumes typed commands from a lock-free MPSC ring; every call except
+//   noor_audio_init() and noor_audio_play_clip() is safe from any task
+// - Full clocks (esp_pm lock, I2S started) only while streaming
+//
+// The app owns its lists: the engine resolves track indices and announcement ids through the
+// callbacks in noor_audio_config_t, from its own task, whenever a command needs one.
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ---------- Compile-time configuration ("Noor audio engine" menu) ---------- */
+#ifdef CONFIG_NOOR_OUT_RATE
+#define NOOR_AUDIO_OUT_RATE       CONFIG_NOOR_OUT_RATE
+#else
+#define NOOR_AUDIO_OUT_RATE       44100   // the only clock I2S ever runs at
+#endif
+#ifdef CONFIG_NOOR_AUDIO_RD_SLOT_KB
+#define NOOR_AUDIO_RD_SLOT_BYTES  (CONFIG_NOOR_AUDIO_RD_SLOT_KB * 1024)
+#define NOOR_AUDIO_RD_SLOT_COUNT  CONFIG_NOOR_AUDIO_RD_SLOTS
+#else
+#define NOOR_AUDIO_RD_SLOT_BYTES  (16 * 1024)   // one FAT allocation unit per read
+#define NOOR_AUDIO_RD_SLOT_COUNT  8             // 8 x 16 KB ~= 370 ms of 44.1 kHz stereo
+#endif
+#ifdef CONFIG_NOOR_AUDIO_DMA_BUF_COUNT
+#define NOOR_AUDIO_DMA_BUF_COUNT  CONFIG_NOOR_AUDIO_DMA_BUF_COUNT
+#define NOOR_AUDIO_DMA_BUF_LEN    CONFIG_NOOR_AUDIO_DMA_BUF_LEN
+#else
+#define NOOR_AUDIO_DMA_BUF_COUNT  4
+#define NOOR_AUDIO_DMA_BUF_LEN    1024          // frames per I2S DMA buffer
+#endif
+#define NOOR_AUDIO_I2S_PORT       0             // I2S_NUM_0
+#define NOOR_AUDIO_BUF_ALIGN      64            // cache line; also a whole number of PIE vectors
+
+/* ---------- WAV ---------- */
+#define NOOR_WAV_FORMAT_PCM        0x0001
+#define NOOR_WAV_FORMAT_IMA_ADPCM  0x0011
+#define NOOR_WAV_FORMAT_EXTENSIBLE 0xFFFE
+
+typedef struct {
+    uint32_t sample_rate;        // 0 = not parsed yet
+    uint16_t format;             // NOOR_WAV_FORMAT_* (extensible resolved to its sub-format)
+    uint16_t bits_per_sample;
+    uint16_t channels;
+    uint16_t block_align;
+    uint32_t data_size;          // 0 = unknown, stream to EOF
+    uint32_t data_offset;
+    uint32_t duration_ms;
+    uint32_t file_size;          // size of the file the header was read from; a cached header is only used while it matches
+} noor_wav_info_t;
+
+// Walks the RIFF chunk list (LIST/INFO, fact, bext, ... are skipped). Leaves f positioned at the
+// first sample byte on success.
+bool noor_wav_parse_header(FILE *f, noor_wav_info_t *info);
+
+/* ---------- Sources ---------- */
+typedef struct {
+    const char *path;
+    noor_wav_info_t *meta;   // optional: a parsed header is used while the file keeps its size, otherwise (re)filled for next time
+} noor_source_t;
+
+// Resolve track idx of the app's current list; false if there is no such track. The entry must
+// stay valid until the next noor_audio_stop_sync().
+typedef bool (*noor_track_fn)(int idx, noor_source_t *out, void *ctx);
+// Path of announcement clip id, or NULL.
+typedef const char *(*noor_clip_fn)(int id, void *ctx);
+// The engine moved on to track (auto-advance), or stopped playing tracks (-1).
+typedef void (*noor_playback_fn)(int track, void *ctx);
+
+typedef struct {
+    int pin_bck, pin_ws, pin_dout;
+    noor_track_fn track;          // NULL: PLAY does nothing
+    noor_clip_fn clip;            // NULL: ANNOUNCE does nothing
+    noor_playback_fn on_playback; // optional; called from the engine task
+    void *ctx;
+    bool auto_advance;            // a finished track chains gaplessly into track + 1
+    bool resume;                  // keep per-track positions in NVS (initialises nvs_flash)
+} noor_audio_config_t;
+
+/* ---------- Engine ---------- */
+// Installs I2S, allocates the read-ahead ring and starts the reader and engine tasks. Output starts
+// idle (I2S stopped, no PM lock). Call once, before any other noor_audio_* call.
+bool noor_audio_init(const noor_audio_config_t *cfg);
+// Only the I2S output, installed as noor_audio_init() does it (same port, rate and DMA ring) and left
+// running, without the read-ahead ring or any task: for tools that drive the port themselves. Either
+// this or noor_audio_init(), once; only cfg's pins are used.
+bool noor_audio_output_init(const noor_audio_config_t *cfg);
+
+// Commands: queued to the engine and applied in order. return false only if the ring stayed full.
+bool noor_audio_play(int track);          // from its resume point when enabled
+bool noor_audio_announce(int clip_id);    // mixed over a playing track when cached, otherwise replaces the stream
+bool noor_audio_pause(int mode);          // 1 = pause, 0 = resume, -1 = toggle
+bool noor_audio_stop(void);
+bool noor_audio_seek(uint32_t ms);        // within the playing track
+bool noor_audio_set_gain(int percent);    // 0..200, ramped over one chunk
+// Like noor_audio_announce, but a sounding announcement finishes first (one clip can wait; any other
+// command replaces it). Over a story it is mixed in as usual.
+bool noor_audio_announce_next(int clip_id);
+// Load clip_id into the announcement cache once the engine has nothing else to do.
+bool noor_audio_cache(int clip_id);
+
+// STOP barrier: returns once every command posted before it has been handled and the engine has
+// let go of the track list (true), or after timeout_ms (false). Uses the caller's task notification.
+bool noor_audio_stop_sync(uint32_t timeout_ms);
+// The same barrier, but the ack also waits for the SD reader to close every file it was handed, and
+// empties the announcement cache. Call before unmounting the card the tracks and clips came from.
+bool noor_audio_release_files(uint32_t timeout_ms);
+
+void noor_audio_set_auto_advance(bool on);
+bool noor_audio_is_playing(void);
+bool noor_audio_is_paused(void);
+int noor_audio_playing_track(void);       // -1 = none
+
+// Play path to the end from the calling task, uninterruptible. Only before the first command has
+// been posted (boot greetings); output stays clocked until the engine's idle delay passes.
+bool noor_audio_play_clip(const char *path);
+// Load a short clip into the announcement cache ahead of its first use (same restriction).
+void noor_audio_cache_clip(const char *path);
+
+// Aligned audio buffer: internal DMA-capable RAM while enough is left, else PSRAM. Free with heap_caps_free().
+void *noor_audio_buf_alloc(size_t bytes, bool *dma);
+
+/* ---------- Statistics ---------- */
+typedef struct {
+    uint32_t ring_underruns;   // writer needed data but the read-ahead ring was empty
+    uint32_t dma_underruns;    // I2S DMA ran dry while a stream was active (TX_Q_OVF): a missed output deadline
+    uint32_t dma_buffers;      // DMA buffers' worth of frames written, one deadline each; misses / this = miss rate
+    uint32_t slots_read;
+    uint32_t max_read_us;      // worst single read of one slot
+    uint32_t cmd_handled;
+    uint32_t cmd_dropped;      // ring full after the push retries
+    uint32_t cmd_lat_last_us;  // enqueue -> applied, or -> first samples for PLAY/ANNOUNCE/SEEK
+    uint32_t cmd_lat_max_us;
+    uint64_t active_us;        // engine holding full clocks
+    uint64_t idle_us;          // no locks held
+    uint32_t activations;
+} noor_audio_stats_t;
+
+void noor_audio_get_stats(noor_audio_stats_t *out);
+// Counters, latency histograms and the recent event trace, to stdout.
+void noor_audio_print_stats(void);
+// Histograms and the trace start over; the counters keep running (per-stream deltas use them).
+void noor_audio_reset_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
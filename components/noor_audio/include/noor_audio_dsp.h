@@ -0,0 +1,261 @@
+// noor_audio_dsp.h
+// Sample kernels of the Noor audio engine: Q15 gain, format conversion to the output rate and the
+// ducking mixer. The engine is their only caller in the firmware; they live in a header so the
+// bench app times exactly the code that ships.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include "noor_audio.h"
+
+#define NOOR_GAIN_UNITY_Q15   32768   // 100% volume; 200% = 65536 still fits the 16x32 multiply
+#ifndef NOOR_GAIN_USE_PIE
+#define NOOR_GAIN_USE_PIE     CONFIG_IDF_TARGET_ESP32S3   // 8-lane S3 vector multiply for steady gains <= 100%
+#endif
+#define NOOR_PCM_CHUNK_BYTES  4096    // stereo output chunk handed to i2s_write
+#define NOOR_CONV_OUT_FRAMES  (NOOR_PCM_CHUNK_BYTES / (2 * sizeof(int16_t)))
+
+/* ---------- Saturation ---------- */
+static inline int16_t noor_clip16(int32_t s) {
+    if (s > 32767) return 32767;
+    if (s < -32768) return -32768;
+    return (int16_t)s;
+}
+
+// Saturate to int16 without branches (CLAMPS on Xtensa).
+static inline int16_t noor_sat16(int32_t s) {
+#if defined(__XTENSA__)
+    int32_t r;
+    __asm__ ("clamps %0, %1, 15" : "=a"(r) : "a"(s));
+    return (int16_t)r;
+#else
+    return noor_clip16(s);
+#endif
+}
+
+/* ---------- Gain stage (Q15, linear ramp per chunk) ---------- */
+// Gains are Q15 with unity = 32768, so 0..200% maps to 0..65536. A volume change is spread as a
+// linear ramp over one whole chunk, which removes the zipper click of a step change.
+static inline int32_t noor_volume_to_q15(int percent) {
+    return (int32_t)(((int64_t)percent * NOOR_GAIN_UNITY_Q15) / 100);
+}
+
+#if NOOR_GAIN_USE_PIE
+// 8 samples per iteration with EE.VMUL.S16 (products >> SAR). Only used for gains below unity, where a
+// Q15 product can never exceed int16, so no saturation is needed; p must be 16-byte aligned.
+// In noor_gain_pie.S: it owns SAR and the hardware loop registers only for the length of the call.
+void noor_gain_const_pie(int16_t *p, size_t n_vec, int16_t gain_q15);
+#endif
+
+static inline void noor_gain_const_scalar(int16_t *p, size_t n, int32_t gain_q15) {
+    for (size_t i = 0; i < n; ++i) p[i] = noor_sat16((p[i] * gain_q15) >> 15);
+}
+
+static inline void noor_gain_const(int16_t *p, size_t n, int32_t gain_q15) {
+#if NOOR_GAIN_USE_PIE
+    if (gain_q15 < NOOR_GAIN_UNITY_Q15) {
+        size_t head = ((16 - ((uintptr_t)p & 15)) & 15) / sizeof(int16_t);
+        if (head > n) head = n;
+        noor_gain_const_scalar(p, head, gain_q15);
+        p += head; n -= head;
+        noor_gain_const_pie(p, n / 8, (int16_t)gain_q15);
+        p += n & ~(size_t)7;
+        n &= 7;
+    }
+#endif
+    noor_gain_const_scalar(p, n, gain_q15);
+}
+
+// Apply gain to interleaved 16-bit frames, ramping linearly from *cur_q15 to target_q15 across them.
+static inline void noor_gain_apply(int16_t *p, size_t frames, uint16_t channels, int32_t *cur_q15, int32_t target_q15) {
+    int32_t g = *cur_q15;
+    if (g == target_q15) {
+        if (g != NOOR_GAIN_UNITY_Q15) noor_gain_const(p, frames * channels, g);
+        return;
+    }
+    // step in Q15 << 8 so short ramps between close gains still move every frame
+    int32_t acc = g << 8;
+    int32_t step = (int32_t)((((int64_t)target_q15 - g) << 8) / (int64_t)(frames ? frames : 1));
+    if (channels == 2) {
+        for (size_t i = 0; i < frames; ++i, p += 2) {
+            int32_t gi = acc >> 8;
+            p[0] = noor_sat16((p[0] * gi) >> 15);
+            p[1] = noor_sat16((p[1] * gi) >> 15);
+            acc += step;
+        }
+    } else {
+        for (size_t i = 0; i < frames; ++i, acc += step) p[i] = noor_sat16((p[i] * (acc >> 8)) >> 15);
+    }
+    *cur_q15 = target_q15;
+}
+
+/* ---------- Format conversion (decoded PCM -> NOOR_AUDIO_OUT_RATE stereo) ---------- */
+// I2S never changes clock, so every source without a rate-matched kernel (below) goes through here:
+// linear interpolation in Q16 phase, mono duplicated to both channels, anything wider than stereo
+// reduced to its first two channels. Decoded PCM already at NOOR_AUDIO_OUT_RATE stereo passes through
+// without a copy. The last input frame of each piece is carried over so interpolation is continuous
+// across pieces, slots and chained files. Mono and stereo get their own interpolation loop with the
+// channel stride fixed at compile time; anything wider goes through the generic one.
+typedef struct noor_conv noor_conv_t;
+typedef size_t (*noor_conv_fn)(noor_conv_t *c, const int16_t *in, size_t in_frames, size_t *in_used, int16_t *out, size_t out_cap);
+
+struct noor_conv {
+    uint32_t step_q16;   // input frames per output frame
+    uint32_t pos_q16;    // next output position; frame i of the piece sits at (i + 1) << 16, prev at 0
+    int16_t prev[2];     // last consumed input frame (L, R)
+    uint16_t in_ch;
+    bool passthrough;
+    noor_conv_fn run;    // picked by noor_conv_setup() for in_ch
+};
+
+// Outputs that still interpolate from prev are done first, so the main loop has a fixed trip count
+// and no per-sample test for frame 0. CH is a constant in the specialised kernels, c->in_ch otherwise.
+#define NOOR_DEFINE_CONV_KERNEL(name, CH)                                                                     \
+static inline size_t name(noor_conv_t *c, const int16_t *in, size_t in_frames, size_t *in_used, int16_t *out, size_t out_cap) { \
+    const size_t ch = (CH);                                                                                \
+    const size_t r = (ch > 1) ? 1 : 0;                                                                     \
+    const uint32_t step = c->step_q16;                                                                     \
+    uint32_t pos = c->pos_q16;                                                                             \
+    size_t n = 0;                                                                                          \
+    if (!in_frames) { *in_used = 0; return 0; }                                                            \
+    for (; (pos >> 16) == 0 && n < out_cap; ++n, pos += step) {                                            \
+        const int32_t f = (pos & 0xFFFF) >> 1;   /* Q15 keeps (s1 - s0) * f inside 32 bits */              \
+        out[2 * n]     = (int16_t)(c->prev[0] + (((in[0] - c->prev[0]) * f) >> 15));                       \
+        out[2 * n + 1] = (int16_t)(c->prev[1] + (((in[r] - c->prev[1]) * f) >> 15));                       \
+    }                                                                                                      \
+    if ((pos >> 16) < in_frames) {                                                                         \
+        size_t cnt = (size_t)((((uint64_t)in_frames << 16) - pos + step - 1) / step);                      \
+        if (cnt > out_cap - n) cnt = out_cap - n;                                                          \
+        for (size_t k = 0; k < cnt; ++k, ++n, pos += step) {                                               \
+            const int16_t *s1 = in + (pos >> 16) * ch;                                                     \
+            const int32_t f = (pos & 0xFFFF) >> 1;                                                         \
+            const int32_t l0 = s1[-(ptrdiff_t)ch], r0 = s1[-(ptrdiff_t)ch + r];                            \
+            out[2 * n]     = (int16_t)(l0 + (((s1[0] - l0) * f) >> 15));                                   \
+            out[2 * n + 1] = (int16_t)(r0 + (((s1[r] - r0) * f) >> 15));                                   \
+        }                                                                                                  \
+    }                                                                                                      \
+    size_t used = pos >> 16;                                                                               \
+    if (used > in_frames) used = in_frames;                                                                \
+    if (used) {                                                                                            \
+        c->prev[0] = in[(used - 1) * ch];                                                                  \
+        c->prev[1] = in[(used - 1) * ch + r];                                                              \
+    }                                                                                                      \
+    c->pos_q16 = pos - ((uint32_t)used << 16);                                                             \
+    *in_used = used;                                                                                       \
+    return n;                                                                                              \
+}
+
+NOOR_DEFINE_CONV_KERNEL(noor_conv_run_mono, 1)
+NOOR_DEFINE_CONV_KERNEL(noor_conv_run_stereo, 2)
+NOOR_DEFINE_CONV_KERNEL(noor_conv_run_any, c->in_ch)
+
+// reset: start from silence (new stream, seek); otherwise keep the phase and history (gapless chain)
+static inline void noor_conv_setup(noor_conv_t *c, const noor_wav_info_t *w, bool reset) {
+    c->step_q16 = (uint32_t)(((uint64_t)w->sample_rate << 16) / NOOR_AUDIO_OUT_RATE);
+    c->in_ch = w->channels;
+    c->passthrough = (w->sample_rate == NOOR_AUDIO_OUT_RATE && w->channels == 2);
+    c->run = (w->channels == 1) ? noor_conv_run_mono : (w->channels == 2) ? noor_conv_run_stereo : noor_conv_run_any;
+    if (reset) {
+        c->pos_q16 = 1u << 16;
+        c->prev[0] = c->prev[1] = 0;
+    }
+}
+
+// Convert up to out_cap frames; *in_used is how many input frames were consumed (the rest is
+// passed again next call). Returns the number of stereo frames written to out.
+static inline size_t noor_conv_run(noor_conv_t *c, const int16_t *in, size_t in_frames, size_t *in_used, int16_t *out, size_t out_cap) {
+    return c->run(c, in, in_frames, in_used, out, out_cap);
+}
+
+/* ---------- Rate-matched PCM kernels (file bytes -> stereo output in one pass) ---------- */
+// A PCM source already at NOOR_AUDIO_OUT_RATE needs no decoder or converter pass: one kernel reads
+// the slot bytes, keeps the top 16 bits of each sample, duplicates mono to both channels and applies
+// a steady gain. Every (channels, bits, unity) combination is generated below with all three fixed at
+// compile time, so the inner loop is a straight load/scale/store the compiler can unroll and vectorise.
+// The engine picks the pair for a track once at open and only chooses unity or gain per chunk; ramps
+// and ducking run the unity kernel and then the gain stage or mixer as before.
+typedef void (*noor_pcm_fn)(const uint8_t *in, size_t frames, int16_t *out, int32_t gain_q15);
+
+typedef struct {
+    const char *name;
+    uint16_t frame_bytes;
+    noor_pcm_fn unity;   // copy/convert only
+    noor_pcm_fn gain;    // with a steady Q15 gain other than unity
+} noor_pcm_kernel_t;
+
+// Sample k of a little-endian buffer, reduced to its top 16 bits (8-bit WAV is unsigned).
+#define NOOR_PCM_LOAD_8(in, k)   (((int32_t)(in)[k] - 128) * 256)
+#define NOOR_PCM_LOAD_16(in, k)  ((int16_t)((in)[2 * (k)] | ((in)[2 * (k) + 1] << 8)))
+#define NOOR_PCM_LOAD_24(in, k)  ((int16_t)((in)[3 * (k) + 1] | ((in)[3 * (k) + 2] << 8)))
+#define NOOR_PCM_LOAD_32(in, k)  ((int16_t)((in)[4 * (k) + 2] | ((in)[4 * (k) + 3] << 8)))
+
+#define NOOR_DEFINE_PCM_KERNEL(name, CH, BITS, UNITY)                                                         \
+static inline void name(const uint8_t *restrict in, size_t frames, int16_t *restrict out, int32_t gain_q15) { \
+    for (size_t i = 0; i < frames; ++i) {                                                                  \
+        const int32_t l = NOOR_PCM_LOAD_##BITS(in, (CH) * i);                                              \
+        const int32_t r = NOOR_PCM_LOAD_##BITS(in, (CH) * i + (CH) - 1);                                   \
+        out[2 * i]     = (UNITY) ? (int16_t)l : noor_sat16((l * gain_q15) >> 15);                          \
+        out[2 * i + 1] = (UNITY) ? (int16_t)r : noor_sat16((r * gain_q15) >> 15);                          \
+    }                                                                                                      \
+}
+
+NOOR_DEFINE_PCM_KERNEL(noor_pcm_u8_mono,         1, 8, 1)
+NOOR_DEFINE_PCM_KERNEL(noor_pcm_u8_mono_gain,    1, 8, 0)
+NOOR_DEFINE_PCM_KERNEL(noor_pcm_s16_mono,        1, 16, 1)
+NOOR_DEFINE_PCM_KERNEL(noor_pcm_s16_mono_gain,   1, 16, 0)
+NOOR_DEFINE_PCM_KERNEL(noor_pcm_s24_mono,        1, 24, 1)
+NOOR_DEFINE_PCM_KERNEL(noor_pcm_s24_mono_gain,   1, 24, 0)
+NOOR_DEFINE_PCM_KERNEL(noor_pcm_s32_mono,        1, 32, 1)
+NOOR_DEFINE_PCM_KERNEL(noor_pcm_s32_mono_gain,   1, 32, 0)
+NOOR_DEFINE_PCM_KERNEL(noor_pcm_u8_stereo,       2, 8, 1)
+NOOR_DEFINE_PCM_KERNEL(noor_pcm_u8_stereo_gain,  2, 8, 0)
+NOOR_DEFINE_PCM_KERNEL(noor_pcm_s24_stereo,      2, 24, 1)
+NOOR_DEFINE_PCM_KERNEL(noor_pcm_s24_stereo_gain, 2, 24, 0)
+NOOR_DEFINE_PCM_KERNEL(noor_pcm_s32_stereo,      2, 32, 1)
+NOOR_DEFINE_PCM_KERNEL(noor_pcm_s32_stereo_gain, 2, 32, 0)
+
+// 16-bit stereo is already the output format: a copy, and the S3 vector multiply for the gain.
+static inline void noor_pcm_s16_stereo(const uint8_t *restrict in, size_t frames, int16_t *restrict out, int32_t gain_q15) {
+    memcpy(out, in, frames * 2 * sizeof(int16_t));
+}
+
+static inline void noor_pcm_s16_stereo_gain(const uint8_t *restrict in, size_t frames, int16_t *restrict out, int32_t gain_q15) {
+    memcpy(out, in, frames * 2 * sizeof(int16_t));
+    noor_gain_const(out, frames * 2, gain_q15);
+}
+
+// Kernel pair for w, or NULL when it needs the decoder/converter path (other rate, ADPCM, > 2 channels).
+static inline const noor_pcm_kernel_t *noor_pcm_kernel_for(const noor_wav_info_t *w) {
+    static const noor_pcm_kernel_t kernels[2][4] = {
+        { { "u8-mono",    1, noor_pcm_u8_mono,    noor_pcm_u8_mono_gain },
+          { "s16-mono",   2, noor_pcm_s16_mono,   noor_pcm_s16_mono_gain },
+          { "s24-mono",   3, noor_pcm_s24_mono,   noor_pcm_s24_mono_gain },
+          { "s32-mono",   4, noor_pcm_s32_mono,   noor_pcm_s32_mono_gain } },
+        { { "u8-stereo",  2, noor_pcm_u8_stereo,  noor_pcm_u8_stereo_gain },
+          { "s16-stereo", 4, noor_pcm_s16_stereo, noor_pcm_s16_stereo_gain },
+          { "s24-stereo", 6, noor_pcm_s24_stereo, noor_pcm_s24_stereo_gain },
+          { "s32-stereo", 8, noor_pcm_s32_stereo, noor_pcm_s32_stereo_gain } },
+    };
+    if (w->format != NOOR_WAV_FORMAT_PCM || w->sample_rate != NOOR_AUDIO_OUT_RATE) return NULL;
+    if (w->channels < 1 || w->channels > 2) return NULL;
+    if (w->bits_per_sample < 8 || w->bits_per_sample > 32 || w->bits_per_sample % 8) return NULL;
+    return &kernels[w->channels - 1][w->bits_per_sample / 8 - 1];
+}
+
+/* ---------- Mixer ---------- */
+// story = story * ramp(*story_q15 -> story_target) + voice * voice_q15, saturated once; both stereo.
+static inline void noor_mix_ducked(int16_t *story, const int16_t *voice, size_t frames, int32_t *story_q15, int32_t story_target, int32_t voice_q15) {
+    const int16_t *v = voice;
+    int32_t acc = *story_q15 << 8;
+    int32_t step = (int32_t)((((int64_t)story_target - *story_q15) << 8) / (int64_t)(frames ? frames : 1));
+    for (size_t i = 0; i < frames; ++i, story += 2, v += 2) {
+        int32_t g = acc >> 8;
+        story[0] = noor_sat16(((story[0] * g) >> 15) + ((v[0] * voice_q15) >> 15));
+        story[1] = noor_sat16(((story[1] * g) >> 15) + ((v[1] * voice_q15) >> 15));
+        acc += step;
+    }
+    *story_q15 = story_target;
+}
@@ -0,0 +1,1593 @@
+// noor_audio.c
+// Noor audio engine (see noor_audio.h): decoders, SD read-ahead, announcement cache and mixer,
+// resume table, command ring and the engine task that streams to I2S.
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "driver/i2s.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_pm.h"
+#include "esp_heap_caps.h"
+#include "esp_rom_crc.h"
+#include "nvs_flash.h"
+#include "nvs.h"
+#include "noor_audio.h"
+#include "noor_audio_dsp.h"
+
+static const char *TAG = "noor_audio";
+
+/* ---------- Audio output ---------- */
+#define I2S_PORT          ((i2s_port_t)NOOR_AUDIO_I2S_PORT)
+#define I2S_DMA_BUF_COUNT NOOR_AUDIO_DMA_BUF_COUNT
+#define I2S_DMA_BUF_LEN   NOOR_AUDIO_DMA_BUF_LEN
+#define AUDIO_OUT_RATE    NOOR_AUDIO_OUT_RATE
+#define I2S_EVT_QUEUE_LEN 64          // drained before every write; holds a writer stall of 64 DMA buffers
+
+/* ---------- SD read-ahead ---------- */
+#define RD_SLOT_COUNT     NOOR_AUDIO_RD_SLOT_COUNT
+#define RD_SLOT_BYTES     NOOR_AUDIO_RD_SLOT_BYTES
+#define AUDIO_BUF_ALIGN   NOOR_AUDIO_BUF_ALIGN
+#define RD_DMA_RESERVE    (48 * 1024) // internal DMA RAM the ring leaves to drivers and stacks
+#define RD_ALIGN_BYTES    (16 * 1024) // FAT allocation unit the cards are formatted with
+
+/* ---------- Tasks ---------- */
+#ifdef CONFIG_NOOR_AUDIO_TASK_PRIO
+#define AUDIO_TASK_PRIO   CONFIG_NOOR_AUDIO_TASK_PRIO
+#define AUDIO_TASK_CORE   CONFIG_NOOR_AUDIO_TASK_CORE
+#define RD_TASK_PRIO      CONFIG_NOOR_AUDIO_READER_PRIO
+#define RD_TASK_CORE      CONFIG_NOOR_AUDIO_READER_CORE
+#else
+#define AUDIO_TASK_PRIO   5
+#define AUDIO_TASK_CORE   1
+#define RD_TASK_PRIO      4
+#define RD_TASK_CORE      0           // SD reader and I2S writer live on different cores
+#endif
+#define AUDIO_TASK_STACK  8192
+#define RD_TASK_STACK     4096
+#define TASK_CORE(c)      ((c) < 0 ? tskNO_AFFINITY : (c))   // Kconfig -1 = either core
+
+/* ---------- Announcement cache ---------- */
+#ifdef CONFIG_NOOR_ANN_CACHE_KB
+#define ANN_CACHE_BUDGET   (CONFIG_NOOR_ANN_CACHE_KB * 1024)
+#define ANN_CACHE_CLIP_MAX (CONFIG_NOOR_ANN_CACHE_CLIP_KB * 1024)
+#else
+#define ANN_CACHE_BUDGET   (1024 * 1024)   // PSRAM bytes for decoded announcement PCM
+#define ANN_CACHE_CLIP_MAX (256 * 1024)    // longer clips always stream from SD
+#endif
+#define ANN_CACHE_SLOTS    24
+
+#ifdef CONFIG_NOOR_MIX_DUCK_PERCENT
+#define MIX_DUCK_PERCENT   CONFIG_NOOR_MIX_DUCK_PERCENT
+#else
+#define MIX_DUCK_PERCENT   25              // story level under a mixed announcement (% of the volume)
+#endif
+
+/* ---------- Instrumentation settings ---------- */
+#define STATS_HIST_BUCKETS 18              // log2 microsecond buckets; the last one collects >= 131 ms
+#define STATS_TRACE_LEN    64              // recent engine events kept for `stats` (power of two)
+#define STATS_SLOW_READ_US 20000           // slot reads slower than this are traced
+
+/* ---------- Resume settings ---------- */
+#define RESUME_SLOTS       16              // most recently played tracks whose position is kept
+#ifdef CONFIG_NOOR_RESUME_SAVE_S
+#define RESUME_SAVE_MS     (CONFIG_NOOR_RESUME_SAVE_S * 1000)
+#else
+#define RESUME_SAVE_MS     30000           // while playing, positions reach NVS at most this often
+#endif
+#define RESUME_REWIND_MS   2000            // restart a little before the stop point
+#define RESUME_MIN_MS      5000            // stopped earlier than this: start over
+#define RESUME_NVS_NS      "noor"
+#define RESUME_NVS_KEY     "resume"
+
+/* ---------- Power management settings ---------- */
+#ifdef CONFIG_NOOR_PM_IDLE_DELAY_MS
+#define PM_IDLE_DELAY_MS CONFIG_NOOR_PM_IDLE_DELAY_MS
+#else
+#define PM_IDLE_DELAY_MS 1000   // engine stays clocked this long after its last command
+#endif
+
+/* ---------- Audio commands ---------- */
+#define CMD_RING_LEN     16   // power of two
+#define CMD_PUSH_RETRIES 5    // ticks a producer waits on a full ring before dropping
+typedef enum { CMD_PLAY = 0, CMD_ANNOUNCE, CMD_PAUSE, CMD_STOP, CMD_SEEK, CMD_SET_GAIN, CMD_ANNOUNCE_NEXT, CMD_CACHE } audio_cmd_type_t;
+typedef struct {
+    audio_cmd_type_t type;
+    int32_t value;    // PLAY: track index, ANNOUNCE/ANNOUNCE_NEXT/CACHE: clip id, PAUSE: 1/0/-1 (toggle), SEEK: ms, SET_GAIN: percent
+    TaskHandle_t ack; // STOP: notified once the engine is idle (noor_audio_stop_sync); value 1 also releases files
+    uint32_t seq;     // assigned on enqueue
+    int64_t t_us;     // esp_timer time of enqueue, for command-to-audio latency
+} audio_cmd_t;
+typedef struct { atomic_uint seq; audio_cmd_t cmd; } cmd_cell_t;
+typedef enum { CTL_RUN = 0, CTL_END, CTL_SEEK, CTL_VOICE } stream_ctl_t;   // VOICE: paused, but a mixed announcement still sounds
+
+/* ---------- Engine state (written by audio_task only; other tasks read it and post commands) ---------- */
+static noor_audio_config_t eng_cfg;
+static TaskHandle_t audio_task_handle = NULL;
+static volatile bool g_pause = false;
+static volatile bool g_playing = false;
+static volatile int playing_track = -1;
+static volatile bool g_auto_advance = false;   // continue with the next track when one finishes
+static volatile int g_volume_percent = 100;    // 0..200%
+
+// App callbacks (see noor_audio_config_t); all called from audio_task.
+static const char *engine_clip_path(int id) {
+    return eng_cfg.clip ? eng_cfg.clip(id, eng_cfg.ctx) : NULL;
+}
+
+static void engine_notify_playback(int track) {
+    if (eng_cfg.on_playback) eng_cfg.on_playback(track, eng_cfg.ctx);
+}
+
+/* ---------- WAV header parsing (RIFF chunk walker) ---------- */
+#define WAV_MAX_CHUNKS 16   // give up on files whose data chunk is buried deeper than this
+static inline uint16_t rd_le16(const uint8_t *p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+static inline uint32_t rd_le32(const uint8_t *p) { return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24); }
+
+// Walks the RIFF chunk list so LIST/INFO, fact, bext, etc. before or between fmt and data are skipped
+// instead of being played as audio. Leaves f positioned at the first sample byte on success.
+bool noor_wav_parse_header(FILE *f, noor_wav_info_t *info) {
+    uint8_t hdr[12];
+    if (fread(hdr, 1, 12, f) != 12) return false;
+    if (memcmp(hdr, "RIFF", 4) != 0 || memcmp(hdr + 8, "WAVE", 4) != 0) return false;
+    memset(info, 0, sizeof(*info));
+    bool have_fmt = false;
+    uint32_t pos = 12;
+    for (int n = 0; n < WAV_MAX_CHUNKS; ++n) {
+        uint8_t ck[8];
+        if (fread(ck, 1, 8, f) != 8) return false;
+        uint32_t ck_size = rd_le32(ck + 4);
+        pos += 8;
+        if (!memcmp(ck, "fmt ", 4)) {
+            uint8_t fmt[40];
+            size_t want = ck_size < sizeof(fmt) ? ck_size : sizeof(fmt);
+            if (want < 16 || fread(fmt, 1, want, f) != want) return false;
+            info->format = rd_le16(fmt);
+            info->channels = rd_le16(fmt + 2);
+            info->sample_rate = rd_le32(fmt + 4);
+            info->block_align = rd_le16(fmt + 12);
+            info->bits_per_sample = rd_le16(fmt + 14);
+            if (info->format == NOOR_WAV_FORMAT_EXTENSIBLE && want >= 26) info->format = rd_le16(fmt + 24);   // SubFormat GUID starts with the tag
+            have_fmt = true;
+            if (fseek(f, (long)(ck_size - want + (ck_size & 1)), SEEK_CUR) != 0) return false;
+        } else if (!memcmp(ck, "data", 4)) {
+            if (!have_fmt || !info->sample_rate || !info->channels) return false;
+            info->data_offset = pos;
+            // 0 / 0xFFFFFFFF come from writers that never patched the size: play until EOF
+            info->data_size = (ck_size == 0xFFFFFFFFu) ? 0 : ck_size;
+            struct stat sb;
+            info->file_size = fstat(fileno(f), &sb) == 0 ? (uint32_t)sb.st_size : 0;   // the open FIL, no SD I/O
+            uint32_t bytes_per_sec = info->sample_rate * (info->block_align ? info->block_align : info->channels * (info->bits_per_sample / 8));
+            if (bytes_per_sec && info->format == NOOR_WAV_FORMAT_PCM) info->duration_ms = (uint32_t)(((uint64_t)info->data_size * 1000) / bytes_per_sec);
+            if (info->format == NOOR_WAV_FORMAT_IMA_ADPCM && info->block_align > 4u * info->channels) {
+                uint32_t spb = (info->block_align - 4u * info->channels) * 2u / info->channels + 1u;
+                info->duration_ms = (uint32_t)((uint64_t)(info->data_size / info->block_align) * spb * 1000 / info->sample_rate);
+            }
+            return true;
+        } else if (fseek(f, (long)(ck_size + (ck_size & 1)), SEEK_CUR) != 0) {
+            return false;
+        }
+        pos += ck_size + (ck_size & 1);
+    }
+    return false;
+}
+
+/* ---------- Audio buffer pool ---------- */
+// Buffers the SD driver reads into are allocated once at boot, cache-line aligned and sized in
+// whole FAT allocation units and I2S DMA buffers. Internal DMA-capable RAM is used while enough of
+// it is left: FATFS then hands whole-sector runs of each read straight to the SD DMA. PSRAM is the
+// fallback, where the driver has to bounce every sector through its own small buffer.
+_Static_assert(RD_SLOT_BYTES % RD_ALIGN_BYTES == 0, "read slot must be whole 16 KB allocation units");
+_Static_assert(RD_SLOT_BYTES % (I2S_DMA_BUF_LEN * 2 * sizeof(int16_t)) == 0, "read slot must be whole I2S DMA buffers");
+
+void *noor_audio_buf_alloc(size_t bytes, bool *dma) {
+    bytes = (bytes + AUDIO_BUF_ALIGN - 1) & ~(size_t)(AUDIO_BUF_ALIGN - 1);
+    void *p = NULL;
+    if (heap_caps_get_free_size(MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL) >= bytes + RD_DMA_RESERVE)
+        p = heap_caps_aligned_alloc(AUDIO_BUF_ALIGN, bytes, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    *dma = (p != NULL);
+    if (!p) p = heap_caps_aligned_alloc(AUDIO_BUF_ALIGN, bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!p) p = heap_caps_aligned_alloc(AUDIO_BUF_ALIGN, bytes, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    return p;
+}
+
+/* ---------- Audio output (I2S installed once at boot, fixed AUDIO_OUT_RATE stereo) ---------- */
+static bool audio_out_ready = false;
+static bool audio_out_running = false;   // i2s_start()ed; stopped between sessions for power management
+static QueueHandle_t i2s_evt_q = NULL;   // driver events; TX_Q_OVF marks a DMA underrun
+
+static bool audio_out_init(int bck, int ws, int dout) {
+    i2s_config_t i2s_cfg = {
+        .mode = I2S_MODE_MASTER | I2S_MODE_TX,
+        .sample_rate = AUDIO_OUT_RATE,
+        .bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT,
+        .channel_format = I2S_CHANNEL_FMT_RIGHT_LEFT,
+        .communication_format = I2S_COMM_FORMAT_I2S,
+        .intr_alloc_flags = 0,
+        .dma_buf_count = I2S_DMA_BUF_COUNT,
+        .dma_buf_len = I2S_DMA_BUF_LEN,
+        .use_apll = false,
+        .tx_desc_auto_clear = true   // DMA sends zeros when we have nothing queued -> silence while idle
+    };
+    i2s_pin_config_t pin_cfg = { .bck_io_num = bck, .ws_io_num = ws, .data_out_num = dout, .data_in_num = I2S_PIN_NO_CHANGE };
+
+    esp_err_t r = i2s_driver_install(I2S_PORT, &i2s_cfg, I2S_EVT_QUEUE_LEN, &i2s_evt_q);
+    if (r != ESP_OK) { ESP_LOGE(TAG, "i2s_driver_install failed: %s", esp_err_to_name(r)); return false; }
+    r = i2s_set_pin(I2S_PORT, &pin_cfg);
+    if (r != ESP_OK) { ESP_LOGE(TAG, "i2s_set_pin failed: %s", esp_err_to_name(r)); i2s_driver_uninstall(I2S_PORT); return false; }
+    i2s_zero_dma_buffer(I2S_PORT);
+    audio_out_ready = true;
+    audio_out_running = true;
+    ESP_LOGI(TAG, "I2S output running (%d Hz stereo, idle silence)", AUDIO_OUT_RATE);
+    return true;
+}
+
+// Drop whatever is still queued in DMA so an interrupted stream stops immediately; output stays running.
+static void audio_out_flush(void) {
+    if (audio_out_ready) i2s_zero_dma_buffer(I2S_PORT);
+}
+
+// Stop/start the peripheral between sessions so the driver's APB lock is released while idle.
+// drain: let the DMA ring play out first (a finished stream's tail is still queued there).
+static void audio_out_stop(bool drain) {
+    if (!audio_out_ready || !audio_out_running) return;
+    if (drain) vTaskDelay(pdMS_TO_TICKS(I2S_DMA_BUF_COUNT * I2S_DMA_BUF_LEN * 1000 / AUDIO_OUT_RATE + 1));
+    i2s_stop(I2S_PORT);
+    audio_out_running = false;
+}
+
+static void audio_out_start(void) {
+    if (!audio_out_ready || audio_out_running) return;
+    i2s_zero_dma_buffer(I2S_PORT);
+    i2s_start(I2S_PORT);
+    audio_out_running = true;
+}
+
+/* ---------- Power management (DFS lock while streaming) ---------- */
+// The engine is the only thing that needs full clocks: while it streams it holds a CPU_FREQ_MAX
+// lock and I2S runs (the legacy driver holds an APB lock while started). Otherwise I2S is stopped
+// and nothing holds a lock, so whatever esp_pm configuration the app chose (DFS minimum, light
+// sleep) applies. SD needs no extra step: sdspi only holds the bus while a transaction runs and,
+// with the reader blocked, the card sits in standby with CS high.
+static bool pm_active = false;
+static int64_t pm_since_us = 0;
+static uint64_t pm_active_us = 0, pm_idle_us = 0;
+static uint32_t pm_activations = 0;
+#ifdef CONFIG_PM_ENABLE
+static esp_pm_lock_handle_t pm_cpu_lock = NULL;
+#endif
+
+static void pm_account(void) {
+    int64_t now = esp_timer_get_time();
+    uint64_t d = (uint64_t)(now - pm_since_us);
+    if (pm_active) pm_active_us += d;
+    else pm_idle_us += d;
+    pm_since_us = now;
+}
+
+// Starts idle: I2S stopped, no locks.
+static bool pm_init(void) {
+    pm_since_us = esp_timer_get_time();
+    audio_out_stop(false);
+#ifdef CONFIG_PM_ENABLE
+    if (esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "audio", &pm_cpu_lock) != ESP_OK) { ESP_LOGE(TAG, "Failed to create PM lock"); return false; }
+#endif
+    return true;
+}
+
+// Called by whoever is about to stream (audio_task, or noor_audio_play_clip for the boot greetings).
+static void pm_audio_active(bool active) {
+    if (active == pm_active) return;
+    pm_account();
+    pm_active = active;
+    if (active) {
+        pm_activations++;
+#ifdef CONFIG_PM_ENABLE
+        if (pm_cpu_lock) esp_pm_lock_acquire(pm_cpu_lock);
+#endif
+        audio_out_start();
+    } else {
+        audio_out_stop(true);
+#ifdef CONFIG_PM_ENABLE
+        if (pm_cpu_lock) esp_pm_lock_release(pm_cpu_lock);
+#endif
+        ESP_LOGI(TAG, "pm: idle (active %llu ms, idle %llu ms)", (unsigned long long)(pm_active_us / 1000), (unsigned long long)(pm_idle_us / 1000));
+    }
+}
+
+/* ---------- Decoders (file bytes -> 16-bit PCM for the gain/I2S stage) ---------- */
+// The reader moves raw file bytes; the writer runs each slot through the source's decoder. A decoder
+// works in units (bytes that decode independently: one frame for PCM, one block for ADPCM) and the
+// reader sizes its slots to whole units. PCM decodes in place; everything else fills the caller's
+// scratch buffer and may take several calls per slot. Heavier codecs (MP3/Opus) would plug into
+// decoder_for() the same way, decoding in sd_reader_task on the other core so the writer only copies.
+#define DEC_OUT_BYTES        8192   // writer scratch for decoded PCM; bounds the largest ADPCM block
+
+typedef struct {
+    const char *name;
+    // unit_bytes of input decode to unit_frames frames of 16-bit PCM
+    bool (*layout)(const noor_wav_info_t *w, uint32_t *unit_bytes, uint32_t *unit_frames);
+    // consume whole units from in; *out points at the PCM (in itself or scratch), returns its byte count
+    size_t (*decode)(const noor_wav_info_t *w, uint8_t *in, size_t in_len, size_t *in_used, int16_t **out, int16_t *scratch, size_t scratch_bytes);
+} decoder_t;
+
+static bool pcm16_layout(const noor_wav_info_t *w, uint32_t *unit_bytes, uint32_t *unit_frames) {
+    *unit_bytes = w->channels * sizeof(int16_t);
+    *unit_frames = 1;
+    return true;
+}
+
+static size_t pcm16_decode(const noor_wav_info_t *w, uint8_t *in, size_t in_len, size_t *in_used, int16_t **out, int16_t *scratch, size_t scratch_bytes) {
+    size_t n = in_len - in_len % (w->channels * sizeof(int16_t));
+    *in_used = in_len;   // a trailing partial frame is dropped
+    *out = (int16_t *)in;
+    return n;
+}
+
+static const decoder_t dec_pcm16 = { "pcm16", pcm16_layout, pcm16_decode };
+
+// 8-bit (unsigned), 24-bit and 32-bit integer PCM: keep the top 16 bits of each sample.
+static bool pcm_int_layout(const noor_wav_info_t *w, uint32_t *unit_bytes, uint32_t *unit_frames) {
+    if (w->bits_per_sample != 8 && w->bits_per_sample != 24 && w->bits_per_sample != 32) return false;
+    *unit_bytes = w->channels * (w->bits_per_sample / 8);
+    *unit_frames = 1;
+    return w->channels * sizeof(int16_t) <= DEC_OUT_BYTES;
+}
+
+static size_t pcm_int_decode(const noor_wav_info_t *w, uint8_t *in, size_t in_len, size_t *in_used, int16_t **out, int16_t *scratch, size_t scratch_bytes) {
+    const uint32_t bps = w->bits_per_sample / 8;
+    size_t n = in_len / bps;
+    if (n > scratch_bytes / sizeof(int16_t)) n = scratch_bytes / sizeof(int16_t);
+    n -= n % w->channels;
+    const uint8_t *p = in;
+    if (bps == 1) {
+        for (size_t i = 0; i < n; ++i) scratch[i] = (int16_t)((p[i] - 128) << 8);
+    } else {
+        p += bps - 2;   // little endian: the two most significant bytes are last
+        for (size_t i = 0; i < n; ++i, p += bps) scratch[i] = (int16_t)rd_le16(p);
+    }
+    *in_used = (n == 0 || n * bps + bps * w->channels > in_len) ? in_len : n * bps;   // drop a trailing partial frame
+    *out = scratch;
+    return n * sizeof(int16_t);
+}
+
+static const decoder_t dec_pcm_int = { "pcm-int", pcm_int_layout, pcm_int_decode };
+
+// IMA-ADPCM as written to WAV (format 0x11): per block a 4-byte header per channel (first sample,
+// step index), then channels interleaved in 4-byte groups of 8 nibbles, low nibble first.
+static const int16_t ima_step[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97,
+    107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+    876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428,
+    4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350,
+    22385, 24623, 27086, 29794, 32767
+};
+static const int8_t ima_index[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+static inline int16_t ima_nibble(int32_t *pred, int32_t *idx, uint8_t n) {
+    int32_t step = ima_step[*idx];
+    int32_t diff = step >> 3;
+    if (n & 1) diff += step >> 2;
+    if (n & 2) diff += step >> 1;
+    if (n & 4) diff += step;
+    *pred = noor_clip16((n & 8) ? *pred - diff : *pred + diff);
+    *idx += ima_index[n & 7];
+    if (*idx < 0) *idx = 0; else if (*idx > 88) *idx = 88;
+    return (int16_t)*pred;
+}
+
+static bool ima_layout(const noor_wav_info_t *w, uint32_t *unit_bytes, uint32_t *unit_frames) {
+    if (w->bits_per_sample != 4 || w->block_align <= 4u * w->channels || (w->block_align - 4u * w->channels) % (4u * w->channels)) return false;
+    *unit_bytes = w->block_align;
+    *unit_frames = (w->block_align - 4u * w->channels) * 2u / w->channels + 1u;
+    return *unit_frames * w->channels * sizeof(int16_t) <= DEC_OUT_BYTES;
+}
+
+static void ima_decode_block(const uint8_t *blk, uint16_t ch, uint32_t frames, int16_t *out) {
+    for (uint16_t c = 0; c < ch; ++c) {
+        const uint8_t *h = blk + 4 * c;
+        int32_t pred = (int16_t)rd_le16(h);
+        int32_t idx = h[2] > 88 ? 88 : h[2];
+        int16_t *o = out + c;
+        *o = (int16_t)pred;
+        o += ch;
+        // this channel's 4-byte groups are every ch-th group after the headers
+        for (uint32_t g = 0; 1 + g * 8 < frames; ++g) {
+            const uint8_t *d = blk + 4 * ch + (g * ch + c) * 4;
+            for (int b = 0; b < 4; ++b) {
+                *o = ima_nibble(&pred, &idx, d[b] & 0x0F); o += ch;
+                *o = ima_nibble(&pred, &idx, d[b] >> 4);   o += ch;
+            }
+        }
+    }
+}
+
+static size_t ima_decode(const noor_wav_info_t *w, uint8_t *in, size_t in_len, size_t *in_used, int16_t **out, int16_t *scratch, size_t scratch_bytes) {
+    uint32_t unit_bytes, unit_frames;
+    ima_layout(w, &unit_bytes, &unit_frames);
+    const size_t out_block = unit_frames * w->channels * sizeof(int16_t);
+    size_t blocks = in_len / unit_bytes;
+    if (blocks > scratch_bytes / out_block) blocks = scratch_bytes / out_block;
+    for (size_t b = 0; b < blocks; ++b) ima_decode_block(in + b * unit_bytes, w->channels, unit_frames, scratch + b * unit_frames * w->channels);
+    *in_used = blocks ? blocks * unit_bytes : in_len;   // nothing whole left: drop the partial block
+    *out = scratch;
+    return blocks * out_block;
+}
+
+static const decoder_t dec_ima_adpcm = { "ima-adpcm", ima_layout, ima_decode };
+
+// NULL if the format has no decoder (or a layout the writer cannot handle).
+static const decoder_t *decoder_for(const noor_wav_info_t *w) {
+    const decoder_t *d = NULL;
+    if (w->format == NOOR_WAV_FORMAT_PCM) d = (w->bits_per_sample == 16) ? &dec_pcm16 : &dec_pcm_int;
+    else if (w->format == NOOR_WAV_FORMAT_IMA_ADPCM) d = &dec_ima_adpcm;
+    uint32_t ub, uf;
+    return (d && w->channels && d->layout(w, &ub, &uf)) ? d : NULL;
+}
+
+/* ---------- Announcement cache (PSRAM, LRU) ---------- */
+// Short clips are kept as raw 16-bit PCM in PSRAM (source rate, converted on the way to I2S), so a knob turn
+// starts sound without opening a file and the SD bus stays free for the story. The app preloads its
+// root clips (noor_audio_cache, or noor_audio_cache_clip before the first command); anything else is
+// loaded on its first play. Owned by the audio task once commands flow.
+typedef struct {
+    char *path;              // NULL = free slot
+    noor_wav_info_t info;
+    uint8_t *pcm;
+    size_t bytes;
+    uint32_t last_used;
+} ann_clip_t;
+
+static ann_clip_t ann_cache[ANN_CACHE_SLOTS];
+static size_t ann_cache_bytes = 0;
+static uint32_t ann_cache_clock = 0;
+static uint32_t ann_cache_hits = 0, ann_cache_misses = 0;
+static const ann_clip_t *ann_cache_pinned = NULL;   // sounding in the mixer: never evicted
+
+static void ann_cache_drop(ann_clip_t *c) {
+    ann_cache_bytes -= c->bytes;
+    heap_caps_free(c->pcm);
+    heap_caps_free(c->path);
+    memset(c, 0, sizeof(*c));
+}
+
+static ann_clip_t *ann_cache_find(const char *path) {
+    for (int i = 0; i < ANN_CACHE_SLOTS; ++i) {
+        if (ann_cache[i].path && !strcmp(ann_cache[i].path, path)) { ann_cache[i].last_used = ++ann_cache_clock; return &ann_cache[i]; }
+    }
+    return NULL;
+}
+
+// Evict least-recently-used clips until `bytes` more fit the budget; returns a free slot or NULL.
+static ann_clip_t *ann_cache_make_room(size_t bytes) {
+    while (1) {
+        ann_clip_t *free_slot = NULL, *lru = NULL;
+        for (int i = 0; i < ANN_CACHE_SLOTS; ++i) {
+            ann_clip_t *c = &ann_cache[i];
+            if (!c->path) { if (!free_slot) free_slot = c; continue; }
+            if (c == ann_cache_pinned) continue;
+            if (!lru || c->last_used < lru->last_used) lru = c;
+        }
+        if (free_slot && ann_cache_bytes + bytes <= ANN_CACHE_BUDGET) return free_slot;
+        if (!lru) return NULL;
+        ESP_LOGI(TAG, "ann cache: evict %s (%u bytes)", lru->path, (unsigned)lru->bytes);
+        ann_cache_drop(lru);
+    }
+}
+
+// Return the cached clip for path, reading it into PSRAM first if it is short enough.
+static ann_clip_t *ann_cache_get(const char *path) {
+    ann_clip_t *c = ann_cache_find(path);
+    if (c) { ann_cache_hits++; return c; }
+    ann_cache_misses++;
+    if (!heap_caps_get_free_size(MALLOC_CAP_SPIRAM)) return NULL;   // no PSRAM: always stream
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    noor_wav_info_t info;
+    struct stat sb;
+    size_t bytes = 0;
+    if (noor_wav_parse_header(f, &info) && info.format == NOOR_WAV_FORMAT_PCM && info.bits_per_sample == 16 && fstat(fileno(f), &sb) == 0) {
+        size_t avail = (size_t)sb.st_size > info.data_offset ? (size_t)sb.st_size - info.data_offset : 0;
+        bytes = (info.data_size && info.data_size < avail) ? info.data_size : avail;
+        bytes -= bytes % (info.channels * sizeof(int16_t));
+    }
+    uint8_t *pcm = NULL;
+    char *key = NULL;
+    if (bytes && bytes <= ANN_CACHE_CLIP_MAX && bytes <= ANN_CACHE_BUDGET && (c = ann_cache_make_room(bytes)) != NULL) {
+        pcm = heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        key = heap_caps_malloc(strlen(path) + 1, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    }
+    bool ok = pcm && key && fread(pcm, 1, bytes, f) == bytes;
+    fclose(f);
+    if (!ok) { heap_caps_free(pcm); heap_caps_free(key); return NULL; }
+    strcpy(key, path);
+    *c = (ann_clip_t){ .path = key, .info = info, .pcm = pcm, .bytes = bytes, .last_used = ++ann_cache_clock };
+    ann_cache_bytes += bytes;
+    ESP_LOGI(TAG, "ann cache: +%s (%u bytes, %u/%u used)", path, (unsigned)bytes, (unsigned)ann_cache_bytes, (unsigned)ANN_CACHE_BUDGET);
+    return c;
+}
+
+// CACHE commands only note the clip; audio_task loads the noted clips one per pass while it has
+// nothing else to do, so a preload never holds up a command or a stream.
+static int ann_preload[ANN_CACHE_SLOTS];   // clip ids, resolved when loaded
+static int ann_preload_n = 0, ann_preload_next = 0;
+
+static void ann_preload_add(int id) {
+    if (ann_preload_n < ANN_CACHE_SLOTS) ann_preload[ann_preload_n++] = id;   // more would not stay cached anyway
+}
+
+// Load the next noted clip; false once there is none left.
+static bool ann_preload_step(void) {
+    if (ann_preload_next >= ann_preload_n) { ann_preload_n = ann_preload_next = 0; return false; }
+    const char *path = engine_clip_path(ann_preload[ann_preload_next++]);
+    if (path) ann_cache_get(path);
+    return true;
+}
+
+/* ---------- Mixer (announcement voice ducked over the story) ---------- */
+// An announcement that arrives while a story streams does not end the story: its cached clip
+// becomes a second voice, mixed into each story chunk in the same pass that applies the story's
+// gain, which ramps down to MIX_DUCK_PERCENT of the volume while the voice sounds and back up once
+// it has finished. The story keeps its file, reader and position, so nothing is reopened. Only clips
+// already in the cache are mixed: loading one would stall the writer mid-story, so any other clip
+// interrupts the story and is loaded once it has stopped. The sounding clip is pinned in the cache.
+// Owned by the audio task.
+typedef struct {
+    const ann_clip_t *clip;   // NULL = no announcement sounding
+    const int16_t *src;       // next source frame
+    size_t frames_left;
+    noor_conv_t conv;
+} mix_voice_t;
+
+static mix_voice_t mix_voice;
+static int16_t mix_buf[NOOR_CONV_OUT_FRAMES * 2] __attribute__((aligned(AUDIO_BUF_ALIGN)));   // voice rendered at the output format
+
+static bool mix_voice_start(const char *path) {
+    const ann_clip_t *clip = path ? ann_cache_find(path) : NULL;   // a newer announcement replaces the sounding one
+    if (!clip) return false;
+    ann_cache_hits++;
+    mix_voice.clip = ann_cache_pinned = clip;
+    mix_voice.src = (const int16_t *)clip->pcm;
+    mix_voice.frames_left = clip->bytes / (clip->info.channels * sizeof(int16_t));
+    noor_conv_setup(&mix_voice.conv, &clip->info, true);
+    return true;
+}
+
+static inline bool mix_voice_active(void) { return mix_voice.clip != NULL; }
+static inline void mix_voice_stop(void) { mix_voice.clip = ann_cache_pinned = NULL; }
+
+// Render the next frames of the voice into mix_buf, zero-padded past its end (frames <= NOOR_CONV_OUT_FRAMES).
+// Returns how many frames carry voice; the voice is released once its last frame is rendered.
+static size_t mix_voice_render(size_t frames) {
+    mix_voice_t *v = &mix_voice;
+    const uint16_t ch = v->clip->info.channels;
+    size_t n = 0;
+    while (n < frames && v->frames_left) {
+        size_t got, used;
+        if (v->conv.passthrough) {
+            got = used = (frames - n < v->frames_left) ? frames - n : v->frames_left;
+            memcpy(mix_buf + 2 * n, v->src, got * 2 * sizeof(int16_t));
+        } else {
+            got = noor_conv_run(&v->conv, v->src, v->frames_left, &used, mix_buf + 2 * n, frames - n);
+        }
+        v->src += used * ch;
+        v->frames_left -= used;
+        n += got;
+    }
+    if (n < frames) memset(mix_buf + 2 * n, 0, (frames - n) * 2 * sizeof(int16_t));
+    if (!v->frames_left) mix_voice_stop();
+    return n;
+}
+
+/* ---------- Resume positions (NVS) ---------- */
+// Where each recently played track stopped, keyed by the CRC of its path, in a small LRU table kept
+// as one NVS blob. The writer updates the table every chunk, but it only reaches flash when it has
+// changed and RESUME_SAVE_MS has passed, or when playback pauses or stops, so a long story costs
+// one NVS write per interval at most and NVS spreads those over its pages. A track that plays to
+// its end is forgotten. Positions are in ms; stream_open_at() turns them back into one seek.
+// Owned by the audio task.
+typedef struct {
+    uint32_t path_crc;   // 0 = free
+    uint32_t ms;
+    uint32_t last_used;
+} resume_ent_t;
+
+static resume_ent_t resume_tab[RESUME_SLOTS];
+static uint32_t resume_clock = 0;
+static bool resume_dirty = false;
+static int64_t resume_saved_us = 0;
+static nvs_handle_t resume_nvs;
+static bool resume_nvs_ok = false;
+
+static uint32_t resume_key(const char *path) {
+    uint32_t crc = esp_rom_crc32_le(0, (const uint8_t *)path, strlen(path));
+    return crc ? crc : 1;
+}
+
+static bool resume_init(void) {
+    esp_err_t r = nvs_flash_init();
+    if (r == ESP_ERR_NVS_NO_FREE_PAGES || r == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ESP_LOGW(TAG, "NVS partition needs erasing (%s)", esp_err_to_name(r));
+        if (nvs_flash_erase() == ESP_OK) r = nvs_flash_init();
+    }
+    if (r == ESP_OK) r = nvs_open(RESUME_NVS_NS, NVS_READWRITE, &resume_nvs);
+    if (r != ESP_OK) { ESP_LOGE(TAG, "NVS unavailable, resume positions not kept: %s", esp_err_to_name(r)); return false; }
+    resume_nvs_ok = true;
+    size_t len = sizeof(resume_tab);
+    r = nvs_get_blob(resume_nvs, RESUME_NVS_KEY, resume_tab, &len);
+    if (r != ESP_OK || len != sizeof(resume_tab)) memset(resume_tab, 0, sizeof(resume_tab));   // none yet, or another layout
+    for (int i = 0; i < RESUME_SLOTS; ++i) if (resume_tab[i].last_used > resume_clock) resume_clock = resume_tab[i].last_used;
+    return true;
+}
+
+static void resume_flush(bool force) {
+    if (!resume_dirty || !resume_nvs_ok) return;
+    int64_t now = esp_timer_get_time();
+    if (!force && now - resume_saved_us < (int64_t)RESUME_SAVE_MS * 1000) return;
+    esp_err_t r = nvs_set_blob(resume_nvs, RESUME_NVS_KEY, resume_tab, sizeof(resume_tab));
+    if (r == ESP_OK) r = nvs_commit(resume_nvs);
+    if (r != ESP_OK) ESP_LOGW(TAG, "resume save failed: %s", esp_err_to_name(r));
+    resume_dirty = false;
+    resume_saved_us = now;
+    ESP_LOGD(TAG, "resume table saved (%lld us)", (long long)(esp_timer_get_time() - now));
+}
+
+static resume_ent_t *resume_find(uint32_t key) {
+    for (int i = 0; i < RESUME_SLOTS; ++i) if (resume_tab[i].path_crc == key) return &resume_tab[i];
+    return NULL;
+}
+
+// ms == 0 forgets the track.
+static void resume_set(const char *path, uint32_t ms) {
+    if (!resume_nvs_ok) return;
+    uint32_t key = resume_key(path);
+    resume_ent_t *e = resume_find(key);
+    if (!ms) {
+        if (e) { memset(e, 0, sizeof(*e)); resume_dirty = true; }
+        return;
+    }
+    if (!e) {
+        e = &resume_tab[0];   // free slot, else the least recently played
+        for (int i = 0; i < RESUME_SLOTS && e->path_crc; ++i) if (!resume_tab[i].path_crc || resume_tab[i].last_used < e->last_used) e = &resume_tab[i];
+        e->path_crc = key;
+        e->last_used = ++resume_clock;
+    }
+    if (e->ms != ms) { e->ms = ms; resume_dirty = true; }
+}
+
+// Where PLAY should start path: a little before it last stopped, or 0.
+static uint32_t resume_start_ms(const char *path) {
+    if (!resume_nvs_ok) return 0;
+    resume_ent_t *e = resume_find(resume_key(path));
+    if (!e || e->ms < RESUME_MIN_MS) return 0;
+    e->last_used = ++resume_clock;
+    return e->ms - RESUME_REWIND_MS;
+}
+
+/* ---------- SD read-ahead task (producer) ---------- */
+// The reader fills a ring of large slots (from the audio buffer pool) so SD latency spikes are
+// absorbed there instead of in the 4-buffer I2S DMA ring. Slots cycle free_q -> reader -> full_q -> writer -> free_q.
+// Every stream gets a generation number; bumping rd_gen cancels the reader at the next slot boundary
+// and lets the writer discard stale slots. Files appended to a stream share its generation and are
+// told apart by seq.
+// Slots are filled with read() on the file's descriptor, so stdio never buffers or splits them (the
+// FILE is only used for the header and closed at the end). When the decoder unit allows it, the
+// first read stops at the next RD_ALIGN_BYTES boundary of the file and every later one covers exactly
+// one allocation unit: FATFS then reads each slot as one multi-sector transfer with no partial-sector
+// copies through its window, and with NOOR_AUDIO_FASTSEEK finds the next cluster in the link map.
+typedef struct {
+    uint8_t *data;
+    size_t len;
+    uint32_t gen;
+    uint8_t seq;      // which source of a chained session this slot belongs to
+    bool eof;
+} rd_slot_t;
+
+typedef struct {
+    FILE *f;
+    uint32_t bytes;   // bytes of sample data still to read
+    uint32_t gen;
+    uint32_t chunk;   // bytes per slot read: RD_SLOT_BYTES rounded down to whole decoder units
+    uint32_t head;    // bytes of the first read, up to an allocation-unit boundary; 0 = start at chunk
+    uint8_t seq;
+} rd_req_t;
+
+static rd_slot_t rd_slots[RD_SLOT_COUNT];
+static int rd_slot_count = 0;
+static int rd_slot_dma = 0;   // slots the SD driver can DMA into directly
+static QueueHandle_t rd_free_q = NULL;
+static QueueHandle_t rd_full_q = NULL;
+static QueueHandle_t rd_req_q = NULL;
+static volatile uint32_t rd_gen = 0;
+static atomic_int rd_files;   // files handed to the reader and not closed yet
+#define RD_WAKE 0xFF   // token pushed into rd_full_q to wake a writer waiting for data
+static noor_audio_stats_t audio_stats;   // pm_* and cmd_dropped are filled in by get_audio_stats()
+
+/* ---------- Instrumentation (latency histograms + event trace, always on) ---------- */
+// Each histogram has one writer (sd_reader_task for reads, audio_task for the rest); the app reads
+// them without locking, so a snapshot taken mid-update is off by one count at worst.
+typedef struct {
+    uint32_t n[STATS_HIST_BUCKETS];   // bucket b: 2^b <= us < 2^(b+1); bucket 0 also holds 0 us
+    uint32_t count;
+    uint32_t max_us;
+    uint64_t sum_us;
+} us_hist_t;
+
+typedef enum { HIST_SD_READ = 0, HIST_I2S_WRITE, HIST_ANN_FIRST, HIST_PLAY_FIRST, HIST_CMD_APPLY, HIST_COUNT } hist_id_t;
+static us_hist_t stats_hist[HIST_COUNT];
+
+static inline void hist_add(hist_id_t id, uint32_t us) {
+    us_hist_t *h = &stats_hist[id];
+    int b = 31 - __builtin_clz(us | 1);
+    h->n[b < STATS_HIST_BUCKETS ? b : STATS_HIST_BUCKETS - 1]++;
+    h->count++;
+    h->sum_us += us;
+    if (us > h->max_us) h->max_us = us;
+}
+
+// Recent notable events in a ring that just overwrites; any task may record one.
+typedef enum { TR_RING_UNDERRUN = 1, TR_DMA_UNDERRUN, TR_SLOW_READ, TR_CMD_AUDIO, TR_STREAM_START, TR_STREAM_END } trace_kind_t;
+typedef struct {
+    uint32_t t_ms;
+    uint8_t kind;   // trace_kind_t
+    uint8_t arg;    // slot index, command type, ...
+    uint32_t val;   // microseconds, running count or track
+} trace_evt_t;
+static trace_evt_t stats_trace[STATS_TRACE_LEN];
+static atomic_uint stats_trace_head;
+
+static void trace_evt(trace_kind_t kind, uint8_t arg, uint32_t val) {
+    unsigned i = atomic_fetch_add_explicit(&stats_trace_head, 1, memory_order_relaxed) % STATS_TRACE_LEN;
+    stats_trace[i] = (trace_evt_t){ .t_ms = (uint32_t)(esp_timer_get_time() / 1000), .kind = kind, .arg = arg, .val = val };
+}
+
+static void sd_reader_task(void *arg) {
+    ESP_LOGI(TAG, "sd_reader_task started (%d x %d bytes, %d DMA-capable)", rd_slot_count, RD_SLOT_BYTES, rd_slot_dma);
+    rd_req_t req;
+    while (1) {
+        if (xQueueReceive(rd_req_q, &req, portMAX_DELAY) != pdTRUE) continue;
+        uint32_t left = req.bytes;
+        const int fd = fileno(req.f);
+        uint32_t want_next = req.head ? req.head : req.chunk;
+        while (req.gen == rd_gen) {
+            uint8_t idx;
+            xQueueReceive(rd_free_q, &idx, portMAX_DELAY);
+            if (req.gen != rd_gen) { xQueueSend(rd_free_q, &idx, 0); break; }
+            rd_slot_t *slot = &rd_slots[idx];
+            size_t want = (left < want_next) ? left : want_next;
+            want_next = req.chunk;
+            int64_t t0 = esp_timer_get_time();
+            ssize_t got = want ? read(fd, slot->data, want) : 0;
+            size_t n = (got > 0) ? (size_t)got : 0;   // an error ends the stream like EOF
+            uint32_t us = (uint32_t)(esp_timer_get_time() - t0);
+            if (us > audio_stats.max_read_us) audio_stats.max_read_us = us;
+            audio_stats.slots_read++;
+            hist_add(HIST_SD_READ, us);
+            if (us > STATS_SLOW_READ_US) trace_evt(TR_SLOW_READ, idx, us);
+            left -= n;
+            slot->len = n;
+            slot->gen = req.gen;
+            slot->seq = req.seq;
+            slot->eof = (n < want) || left == 0;
+            xQueueSend(rd_full_q, &idx, portMAX_DELAY);
+            if (slot->eof) break;
+        }
+        fclose(req.f);
+        atomic_fetch_sub(&rd_files, 1);
+    }
+}
+
+static bool sd_reader_init(void) {
+    rd_free_q = xQueueCreate(RD_SLOT_COUNT, sizeof(uint8_t));
+    rd_full_q = xQueueCreate(RD_SLOT_COUNT + 1, sizeof(uint8_t));   // +1 for an RD_WAKE token
+    rd_req_q = xQueueCreate(2, sizeof(rd_req_t));
+    if (!rd_free_q || !rd_full_q || !rd_req_q) { ESP_LOGE(TAG, "Failed to create reader queues"); return false; }
+    for (int i = 0; i < RD_SLOT_COUNT; ++i) {
+        bool dma;
+        uint8_t *p = noor_audio_buf_alloc(RD_SLOT_BYTES, &dma);
+        if (!p) break;
+        rd_slots[i].data = p;
+        rd_slot_dma += dma;
+        uint8_t idx = (uint8_t)i;
+        xQueueSend(rd_free_q, &idx, 0);
+        rd_slot_count++;
+    }
+    if (rd_slot_count < 2) { ESP_LOGE(TAG, "Not enough memory for read-ahead ring"); return false; }
+    if (rd_slot_count < RD_SLOT_COUNT) ESP_LOGW(TAG, "Read-ahead ring reduced to %d slots", rd_slot_count);
+    return xTaskCreatePinnedToCore(sd_reader_task, "sd_reader", RD_TASK_STACK, NULL, RD_TASK_PRIO, NULL, TASK_CORE(RD_TASK_CORE)) == pdPASS;
+}
+
+// Hand an opened file to the reader; its descriptor must sit at file_off, the first byte to read.
+// The reader owns and closes it.
+static uint32_t rd_chunk_for(uint32_t unit_bytes) {
+    return (unit_bytes && unit_bytes <= RD_SLOT_BYTES) ? RD_SLOT_BYTES - RD_SLOT_BYTES % unit_bytes : RD_SLOT_BYTES;
+}
+
+// Aligned reads only when every slot still holds whole units, i.e. the unit divides both the short
+// first read and the allocation unit.
+static uint32_t rd_head_for(uint32_t file_off, uint32_t unit_bytes) {
+    uint32_t head = (RD_ALIGN_BYTES - file_off % RD_ALIGN_BYTES) % RD_ALIGN_BYTES;
+    if (!unit_bytes || RD_ALIGN_BYTES % unit_bytes || head % unit_bytes) return 0;
+    return head;
+}
+
+static uint32_t sd_reader_start(FILE *f, uint32_t file_off, uint32_t bytes, uint32_t unit_bytes) {
+    rd_req_t req = { .f = f, .bytes = bytes, .gen = ++rd_gen, .chunk = rd_chunk_for(unit_bytes), .head = rd_head_for(file_off, unit_bytes), .seq = 0 };
+    atomic_fetch_add(&rd_files, 1);
+    xQueueSend(rd_req_q, &req, portMAX_DELAY);
+    return req.gen;
+}
+
+// Queue a file behind the running stream in the same generation: the reader moves on to it at EOF
+// without waiting for the writer, so the ring never drains between chained sources.
+static void sd_reader_append(FILE *f, uint32_t file_off, uint32_t bytes, uint32_t unit_bytes, uint8_t seq) {
+    rd_req_t req = { .f = f, .bytes = bytes, .gen = rd_gen, .chunk = rd_chunk_for(unit_bytes), .head = rd_head_for(file_off, unit_bytes), .seq = seq };
+    atomic_fetch_add(&rd_files, 1);
+    xQueueSend(rd_req_q, &req, portMAX_DELAY);
+}
+
+// Cancel the current stream and give every queued slot back to the reader.
+static void sd_reader_cancel(void) {
+    rd_gen++;
+    uint8_t idx;
+    while (xQueueReceive(rd_full_q, &idx, 0) == pdTRUE) {
+        if (idx != RD_WAKE) xQueueSend(rd_free_q, &idx, 0);
+    }
+}
+
+// TX_Q_OVF events only count while output is being fed without a break. Every stream end and every
+// pause ends a run (dma_watch_stop); the first write of the next one discards what piled up in
+// between, when DMA ran dry on purpose.
+static bool dma_watch = false;
+
+static inline void dma_watch_stop(void) { dma_watch = false; }
+
+static void count_dma_underruns(void) {
+    i2s_event_t ev;
+    while (i2s_evt_q && xQueueReceive(i2s_evt_q, &ev, 0) == pdTRUE) {
+        if (ev.type == I2S_EVENT_TX_Q_OVF) trace_evt(TR_DMA_UNDERRUN, 0, ++audio_stats.dma_underruns);
+    }
+}
+
+// i2s_write of stereo frames, with the time it blocked on DMA space recorded. Every DMA buffer
+// filled is one output deadline; a TX_Q_OVF is one missed. Every path that writes goes through here.
+static esp_err_t audio_write(const int16_t *buf, size_t frames, size_t *written) {
+    static size_t frames_partial = 0;   // written toward the next whole DMA buffer
+    if (dma_watch) count_dma_underruns();
+    int64_t t0 = esp_timer_get_time();
+    esp_err_t res = i2s_write(I2S_PORT, buf, frames * 2 * sizeof(int16_t), written, pdMS_TO_TICKS(1000));
+    hist_add(HIST_I2S_WRITE, (uint32_t)(esp_timer_get_time() - t0));
+    frames_partial += *written / (2 * sizeof(int16_t));
+    audio_stats.dma_buffers += frames_partial / I2S_DMA_BUF_LEN;
+    frames_partial %= I2S_DMA_BUF_LEN;
+    if (!dma_watch) {
+        if (i2s_evt_q) xQueueReset(i2s_evt_q);   // idle and paused OVF events don't count
+        dma_watch = true;
+    }
+    return res;
+}
+
+/* ---------- Audio command ring (lock-free MPSC: UI tasks -> audio_task) ---------- */
+// Bounded ring after Vyukov: producers claim a position with one CAS on cmd_head and publish the cell
+// through its sequence word, audio_task is the only consumer. The claimed position doubles as the
+// command sequence number. After publishing, producers ring a doorbell (task notification count,
+// never a value, so nothing is overwritten) and wake a writer that is waiting on the read-ahead ring.
+static cmd_cell_t cmd_ring[CMD_RING_LEN];
+static atomic_uint cmd_head;
+static uint32_t cmd_tail = 0;                 // consumer side only
+static atomic_uint cmd_dropped;
+static audio_cmd_t eng_next;                  // command that ended the current stream, run next
+static bool eng_has_next = false;
+static int64_t cmd_armed_us = 0;              // enqueue time of the command whose audio has not started yet
+static uint32_t cmd_armed_seq = 0;
+static audio_cmd_type_t cmd_armed_type = CMD_PLAY;
+
+static const char *cmd_name(audio_cmd_type_t t) {
+    static const char *names[] = { "PLAY", "ANNOUNCE", "PAUSE", "STOP", "SEEK", "SET_GAIN", "ANNOUNCE_NEXT", "CACHE" };
+    return (unsigned)t < sizeof(names) / sizeof(names[0]) ? names[t] : "?";
+}
+
+static void cmd_ring_init(void) {
+    for (unsigned i = 0; i < CMD_RING_LEN; ++i) atomic_init(&cmd_ring[i].seq, i);
+    atomic_init(&cmd_head, 0);
+    atomic_init(&cmd_dropped, 0);
+}
+
+static void get_audio_stats(noor_audio_stats_t *out) {
+    if (!out) return;
+    *out = audio_stats;
+    out->cmd_dropped = atomic_load(&cmd_dropped);
+    uint64_t open_us = (uint64_t)(esp_timer_get_time() - pm_since_us);   // the running period, not yet accounted
+    out->active_us = pm_active_us + (pm_active ? open_us : 0);
+    out->idle_us = pm_idle_us + (pm_active ? 0 : open_us);
+    out->activations = pm_activations;
+}
+
+static bool cmd_push(audio_cmd_t *c) {
+    unsigned pos = atomic_load_explicit(&cmd_head, memory_order_relaxed);
+    cmd_cell_t *cell;
+    while (1) {
+        cell = &cmd_ring[pos & (CMD_RING_LEN - 1)];
+        unsigned s = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        int dif = (int)(s - pos);
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(&cmd_head, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) break;
+        } else if (dif < 0) {
+            return false;   // full: the consumer has not freed this cell yet
+        } else {
+            pos = atomic_load_explicit(&cmd_head, memory_order_relaxed);
+        }
+    }
+    c->seq = pos;
+    cell->cmd = *c;
+    atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+    return true;
+}
+
+static bool cmd_pop(audio_cmd_t *out) {
+    cmd_cell_t *cell = &cmd_ring[cmd_tail & (CMD_RING_LEN - 1)];
+    unsigned s = atomic_load_explicit(&cell->seq, memory_order_acquire);
+    if ((int)(s - (cmd_tail + 1)) < 0) return false;   // empty, or the producer has not published yet
+    *out = cell->cmd;
+    atomic_store_explicit(&cell->seq, cmd_tail + CMD_RING_LEN, memory_order_release);
+    cmd_tail++;
+    return true;
+}
+
+// Post a command to the audio engine (task context). A full ring means audio_task is stuck;
+// give it a few ticks before dropping.
+static bool audio_cmd_send(audio_cmd_type_t type, int32_t value, TaskHandle_t ack) {
+    audio_cmd_t c = { .type = type, .value = value, .ack = ack, .t_us = esp_timer_get_time() };
+    int tries = 0;
+    while (!cmd_push(&c)) {
+        if (++tries > CMD_PUSH_RETRIES) {
+            atomic_fetch_add(&cmd_dropped, 1);
+            ESP_LOGW(TAG, "command ring full: dropped %s", cmd_name(type));
+            return false;
+        }
+        vTaskDelay(1);
+    }
+    if (audio_task_handle) xTaskNotifyGive(audio_task_handle);
+    // a writer stalled on an empty ring would otherwise only see the command once the SD delivers
+    uint8_t wake = RD_WAKE;
+    if (rd_full_q && uxQueueMessagesWaiting(rd_full_q) == 0) xQueueSendToFront(rd_full_q, &wake, 0);
+    return true;
+}
+
+static uint32_t cmd_record_latency(uint32_t seq, int64_t t_us, const char *what) {
+    uint32_t us = (uint32_t)(esp_timer_get_time() - t_us);
+    audio_stats.cmd_handled++;
+    audio_stats.cmd_lat_last_us = us;
+    if (us > audio_stats.cmd_lat_max_us) audio_stats.cmd_lat_max_us = us;
+    ESP_LOGD(TAG, "cmd #%u %s: %u us", (unsigned)seq, what, (unsigned)us);
+    return us;
+}
+
+// Audible commands (PLAY/ANNOUNCE/SEEK) count until their first samples reach I2S.
+static void cmd_arm(const audio_cmd_t *c) {
+    cmd_armed_us = c->t_us;
+    cmd_armed_seq = c->seq;
+    cmd_armed_type = c->type;
+}
+
+static void cmd_audio_started(void) {
+    if (!cmd_armed_us) return;
+    uint32_t us = cmd_record_latency(cmd_armed_seq, cmd_armed_us, "to audio");
+    hist_add((cmd_armed_type == CMD_ANNOUNCE || cmd_armed_type == CMD_ANNOUNCE_NEXT) ? HIST_ANN_FIRST : HIST_PLAY_FIRST, us);
+    trace_evt(TR_CMD_AUDIO, (uint8_t)cmd_armed_type, us);
+    cmd_armed_us = 0;
+}
+
+// Commands that only change engine state; valid while streaming or idle.
+static void engine_apply(const audio_cmd_t *c) {
+    if (c->type == CMD_PAUSE) {
+        g_pause = (c->value < 0) ? !g_pause : (c->value != 0);
+        ESP_LOGI(TAG, "cmd #%u: %s", (unsigned)c->seq, g_pause ? "PAUSED" : "PLAYING");
+    } else if (c->type == CMD_SET_GAIN) {
+        g_volume_percent = (c->value < 0) ? 0 : (c->value > 200) ? 200 : c->value;
+    } else if (c->type == CMD_CACHE) {
+        ann_preload_add(c->value);
+    }
+    hist_add(HIST_CMD_APPLY, cmd_record_latency(c->seq, c->t_us, "applied"));
+}
+
+// Per-chunk control check shared by every source: drains the command ring, returns at once while
+// running and sleeps on the doorbell while paused (unless a mixed announcement still sounds).
+// ANNOUNCE of a cached clip over a story starts the mixer voice; PLAY/STOP, and any other ANNOUNCE,
+// end the stream and are kept in eng_next for audio_task. ANNOUNCE_NEXT over an announcement is kept
+// there too but lets the clip finish; whatever arrives before then replaces it. Non-interruptible
+// streams (played by noor_audio_play_clip) leave the ring alone.
+static stream_ctl_t stream_poll(bool interruptible, bool pausable, uint32_t *seek_ms) {
+    if (!interruptible) return CTL_RUN;
+    audio_cmd_t c;
+    while (1) {
+        while (cmd_pop(&c)) {
+            switch (c.type) {
+            case CMD_PAUSE:
+            case CMD_SET_GAIN:
+            case CMD_CACHE:
+                engine_apply(&c);
+                break;
+            case CMD_SEEK:
+                if (!pausable) { cmd_record_latency(c.seq, c.t_us, "ignored"); break; }   // announcements don't seek
+                cmd_arm(&c);
+                *seek_ms = (uint32_t)c.value;
+                return CTL_SEEK;
+            case CMD_ANNOUNCE_NEXT:
+                if (!pausable && !eng_has_next) {
+                    eng_next = c;
+                    eng_has_next = true;
+                    break;
+                }
+                /* fall through */
+            case CMD_ANNOUNCE:
+                // over a story with the clip cached: mix it in and keep streaming; otherwise it replaces the stream
+                if (pausable && mix_voice_start(engine_clip_path(c.value))) {
+                    ESP_LOGI(TAG, "cmd #%u: mixing %s over the story", (unsigned)c.seq, mix_voice.clip->path);
+                    cmd_arm(&c);
+                    break;
+                }
+                /* fall through */
+            default:
+                eng_next = c;
+                eng_has_next = true;
+                return CTL_END;
+            }
+        }
+        if (!(pausable && g_pause)) { pm_audio_active(true); return CTL_RUN; }
+        if (mix_voice_active()) { pm_audio_active(true); return CTL_VOICE; }
+        dma_watch_stop();     // DMA runs dry on purpose while paused
+        resume_flush(true);   // a pause may well end with the power switch
+        // paused: sleep until the next command, dropping clocks if the pause outlasts PM_IDLE_DELAY_MS
+        if (!ulTaskNotifyTake(pdTRUE, pm_active ? pdMS_TO_TICKS(PM_IDLE_DELAY_MS) : portMAX_DELAY)) pm_audio_active(false);
+    }
+}
+
+/* ---------- Stream file with interruption, pause, and volume support (I2S writer / consumer) ---------- */
+// Blocks only on the control group (pause/stop), the read-ahead ring and I2S DMA space;
+// nothing here depends on the tick rate.
+typedef struct {
+    const char *path;
+    noor_wav_info_t *meta;   // optional: a parsed header is used while file_size matches, otherwise (re)filled for next time
+    int track;          // index into the app's track list, -1 for announcements
+    uint32_t start_ms;  // resume point; chained sources always start at 0
+} stream_src_t;
+
+// Picks the source to chain after cur; false ends the session when cur finishes.
+typedef bool (*stream_next_fn)(const stream_src_t *cur, stream_src_t *next);
+
+// Open a source and leave its descriptor at the sample data (the reader bypasses stdio, so an fseek
+// that only moved inside the stdio buffer would not do); NULL if missing or no decoder handles it.
+static FILE *stream_open(const stream_src_t *src, noor_wav_info_t *winfo, const decoder_t **dec) {
+    FILE *f = fopen(src->path, "rb");
+    if (!f) { ESP_LOGW(TAG, "stream_file: not found: %s", src->path); return NULL; }
+    struct stat sb;
+    // a cached header is trusted only while the file has the size it was parsed from (fstat reads the open
+    // FIL, no SD I/O); a file re-exported under the same name almost always changes size with its format
+    if (src->meta && src->meta->sample_rate && src->meta->file_size && fstat(fileno(f), &sb) == 0 && (uint64_t)sb.st_size == src->meta->file_size) {
+        *winfo = *src->meta;   // known track: no header read, just position at the samples
+    } else {
+        if (!noor_wav_parse_header(f, winfo)) { ESP_LOGE(TAG, "Invalid WAV header: %s", src->path); fclose(f); return NULL; }
+        if (src->meta) *src->meta = *winfo;
+    }
+    if (lseek(fileno(f), (off_t)winfo->data_offset, SEEK_SET) < 0) { ESP_LOGE(TAG, "seek failed: %s", src->path); fclose(f); return NULL; }
+    *dec = decoder_for(winfo);
+    if (!*dec) {
+        ESP_LOGE(TAG, "Unsupported format 0x%04x/%u-bit: %s", winfo->format, winfo->bits_per_sample, src->path);
+        fclose(f);
+        return NULL;
+    }
+    return f;
+}
+
+// Reopen src ms into its samples (rounded down to a decoder unit); *left is the byte count still to play.
+static FILE *stream_open_at(const stream_src_t *src, noor_wav_info_t *winfo, const decoder_t **dec, uint32_t ms, uint32_t *left) {
+    FILE *f = stream_open(src, winfo, dec);
+    if (!f) return NULL;
+    uint32_t unit_bytes, unit_frames;
+    (*dec)->layout(winfo, &unit_bytes, &unit_frames);
+    const uint32_t total = winfo->data_size ? winfo->data_size : UINT32_MAX;
+    uint64_t off = (uint64_t)ms * winfo->sample_rate / 1000 / unit_frames * unit_bytes;
+    if (off > total) off = total - (total % unit_bytes);
+    if (off && lseek(fileno(f), (off_t)(winfo->data_offset + off), SEEK_SET) < 0) { ESP_LOGE(TAG, "seek failed: %s", src->path); fclose(f); return NULL; }
+    *left = total - (uint32_t)off;
+    return f;
+}
+
+static uint32_t stream_unit_bytes(const decoder_t *dec, const noor_wav_info_t *w) {
+    uint32_t unit_bytes, unit_frames;
+    dec->layout(w, &unit_bytes, &unit_frames);
+    return unit_bytes;
+}
+
+// Inverse of stream_open_at(): ms into the samples after pos data bytes.
+static uint32_t stream_pos_ms(const decoder_t *dec, const noor_wav_info_t *w, uint32_t pos) {
+    uint32_t unit_bytes, unit_frames;
+    dec->layout(w, &unit_bytes, &unit_frames);
+    return (uint32_t)((uint64_t)(pos / unit_bytes) * unit_frames * 1000 / w->sample_rate);
+}
+
+// Tracks remember where they stopped; announcements do not.
+static void stream_note_pos(const stream_src_t *src, const decoder_t *dec, const noor_wav_info_t *w, uint32_t pos) {
+    if (src->track >= 0) resume_set(src->path, stream_pos_ms(dec, w, pos));
+}
+
+// Stream first, then every source next_fn chains after it. A chained source is opened and queued
+// to the reader as soon as the previous one starts, so its first slots are already in the ring when
+// the previous one hits EOF and the writer carries on without a flush. Any format chains: the
+// converter just picks up the new rate/channels. PCM at the output rate goes from slot bytes to
+// output in one pass through the kernel picked for it at open (noor_pcm_kernel_for()); anything else
+// is decoded in pieces of at most DEC_OUT_BYTES of PCM and each piece converted. Either way output
+// moves in NOOR_CONV_OUT_FRAMES chunks, with a control check before every chunk. A mixed announcement is added to the chunks as they go, and plays on by
+// itself while the story is paused or after it has ended.
+static bool stream_session(const stream_src_t *first, stream_next_fn next_fn, bool interruptible, bool pausable) {
+    static int16_t dec_out[DEC_OUT_BYTES / sizeof(int16_t)] __attribute__((aligned(AUDIO_BUF_ALIGN)));
+    static int16_t conv_out[NOOR_CONV_OUT_FRAMES * 2] __attribute__((aligned(AUDIO_BUF_ALIGN)));
+    if (!first || !first->path) return false;
+    if (!audio_out_ready || !rd_slot_count) { ESP_LOGE(TAG, "stream_file: audio pipeline not initialised"); return false; }
+    noor_wav_info_t winfo, next_info;
+    const decoder_t *dec, *next_dec = NULL;
+    uint32_t left;
+    FILE *f = stream_open_at(first, &winfo, &dec, first->start_ms, &left);
+    if (!f) return false;
+    uint32_t pos = (winfo.data_size ? winfo.data_size : UINT32_MAX) - left;   // data bytes of cur consumed by the writer
+    if (pos) ESP_LOGI(TAG, "resume %s at %u ms", first->path, (unsigned)first->start_ms);
+    noor_conv_t conv;
+    noor_conv_setup(&conv, &winfo, true);
+    const noor_pcm_kernel_t *kern = noor_pcm_kernel_for(&winfo);
+    ESP_LOGD(TAG, "%s: %s path", first->path, kern ? kern->name : dec->name);
+
+    uint32_t underruns_before = audio_stats.ring_underruns + audio_stats.dma_underruns;
+    uint32_t buffers_before = audio_stats.dma_buffers;
+    trace_evt(TR_STREAM_START, 0, (uint32_t)first->track);
+    uint32_t gen = sd_reader_start(f, winfo.data_offset + pos, left, stream_unit_bytes(dec, &winfo));
+
+    stream_src_t cur = *first, next;
+    uint8_t cur_seq = 0;
+    bool chain_checked = (next_fn == NULL);   // one chaining attempt per source
+    bool chained = false;
+    int32_t gain_q15 = noor_volume_to_q15(g_volume_percent);
+    bool interrupted = false;
+    bool started = false;
+    bool story_done = false;   // last source ended; only the announcement voice is left
+    uint8_t idx = 0;
+    rd_slot_t *slot = NULL;   // slot being decoded, slot_off bytes in
+    size_t slot_off = 0;
+    int16_t *pcm = NULL;      // decoded piece still waiting for conversion
+    size_t pcm_frames = 0;
+    while (1) {
+        uint32_t seek_ms = 0;
+        stream_ctl_t ctl = stream_poll(interruptible, pausable, &seek_ms);
+        if (ctl == CTL_END) {
+            ESP_LOGI(TAG, "stream interrupted by %s: %s", cmd_name(eng_next.type), cur.path);
+            interrupted = true;
+            break;
+        }
+        if (ctl == CTL_SEEK) {
+            // restart the reader inside the current source; anything chained behind it is requeued later
+            FILE *sf = stream_open_at(&cur, &winfo, &dec, seek_ms, &left);
+            if (!sf) continue;
+            pos = (winfo.data_size ? winfo.data_size : UINT32_MAX) - left;
+            if (slot) { xQueueSend(rd_free_q, &idx, 0); slot = NULL; }
+            pcm_frames = 0;
+            sd_reader_cancel();
+            audio_out_flush();
+            noor_conv_setup(&conv, &winfo, true);
+            kern = noor_pcm_kernel_for(&winfo);
+            gen = sd_reader_start(sf, winfo.data_offset + pos, left, stream_unit_bytes(dec, &winfo));
+            cur_seq = 0;
+            chained = false;
+            chain_checked = (next_fn == NULL);
+            story_done = false;
+            ESP_LOGI(TAG, "seek %s -> %u ms", cur.path, (unsigned)seek_ms);
+            continue;
+        }
+        if (ctl == CTL_VOICE || story_done) {
+            if (!mix_voice_active()) break;   // only reached with story_done
+            int32_t vol_q15 = noor_volume_to_q15(g_volume_percent);
+            size_t n = mix_voice_render(NOOR_CONV_OUT_FRAMES);
+            noor_gain_apply(mix_buf, n, 2, &vol_q15, vol_q15);
+            size_t written = 0;
+            if (n && audio_write(mix_buf, n, &written) == ESP_OK && written) cmd_audio_started();
+            continue;
+        }
+
+        if (!slot) {
+            if (started && uxQueueMessagesWaiting(rd_full_q) == 0) trace_evt(TR_RING_UNDERRUN, 0, ++audio_stats.ring_underruns);
+            xQueueReceive(rd_full_q, &idx, portMAX_DELAY);
+            if (idx == RD_WAKE) continue;   // command posted while waiting for data; poll the ring
+            if (rd_slots[idx].gen != gen) { xQueueSend(rd_free_q, &idx, 0); continue; }   // left over from a cancelled stream
+            slot = &rd_slots[idx];
+            slot_off = 0;
+            if (slot->seq != cur_seq) {
+                // first slot of the chained source: the converter follows its format, the DMA ring just keeps going
+                if (cur.track >= 0) resume_set(cur.path, 0);   // played to the end
+                cur = next;
+                pos = 0;
+                winfo = next_info;
+                dec = next_dec;
+                noor_conv_setup(&conv, &winfo, false);
+                kern = noor_pcm_kernel_for(&winfo);
+                cur_seq = slot->seq;
+                chained = false;
+                chain_checked = false;
+                if (cur.track >= 0) { playing_track = cur.track; engine_notify_playback(cur.track); }   // selection follows playback
+                ESP_LOGI(TAG, "gapless -> %s", cur.path);
+            }
+        }
+
+        int32_t vol_q15 = noor_volume_to_q15(g_volume_percent);
+        const bool mixing = mix_voice_active();
+        bool gained = false;   // the kernel already applied a steady gain
+        int16_t *out;
+        size_t out_frames;
+        if (kern) {
+            const size_t fb = kern->frame_bytes;
+            out_frames = (slot->len - slot_off) / fb;
+            if (out_frames > NOOR_CONV_OUT_FRAMES) out_frames = NOOR_CONV_OUT_FRAMES;
+            gained = !mixing && gain_q15 == vol_q15;
+            noor_pcm_fn run = (gained && vol_q15 != NOOR_GAIN_UNITY_Q15) ? kern->gain : kern->unity;
+            run(slot->data + slot_off, out_frames, conv_out, vol_q15);
+            out = conv_out;
+            size_t used = out_frames * fb;
+            if (slot->len - slot_off - used < fb) used = slot->len - slot_off;   // a trailing partial frame is dropped
+            slot_off += used;
+            pos += used;
+            if (pausable && slot_off >= slot->len) {
+                stream_note_pos(&cur, dec, &winfo, pos);
+                resume_flush(false);
+            }
+        } else {
+            if (!pcm_frames) {
+                size_t used = 0;
+                size_t pcm_bytes = dec->decode(&winfo, slot->data + slot_off, slot->len - slot_off, &used, &pcm, dec_out, sizeof(dec_out));
+                slot_off += used;
+                pos += used;
+                if (pausable) {
+                    stream_note_pos(&cur, dec, &winfo, pos);
+                    resume_flush(false);
+                }
+                pcm_frames = pcm_bytes / (winfo.channels * sizeof(int16_t));
+            }
+            out = pcm;
+            out_frames = pcm_frames;
+            if (conv.passthrough) {
+                if (out_frames > NOOR_CONV_OUT_FRAMES) out_frames = NOOR_CONV_OUT_FRAMES;   // same chunking as converted sources
+                pcm += out_frames * 2;
+                pcm_frames -= out_frames;
+            } else {
+                size_t in_used = 0;
+                out = conv_out;
+                out_frames = noor_conv_run(&conv, pcm, pcm_frames, &in_used, conv_out, NOOR_CONV_OUT_FRAMES);
+                pcm += in_used * winfo.channels;
+                pcm_frames -= in_used;
+            }
+        }
+
+        // volume (16-bit stereo) unless the kernel did it; changes ramp over this chunk, and so does ducking under an announcement
+        if (mixing) {
+            mix_voice_render(out_frames);
+            noor_mix_ducked(out, mix_buf, out_frames, &gain_q15, vol_q15 * MIX_DUCK_PERCENT / 100, vol_q15);
+        } else if (!gained) {
+            noor_gain_apply(out, out_frames, 2, &gain_q15, vol_q15);
+        }
+
+        size_t written = 0;
+        esp_err_t res = out_frames ? audio_write(out, out_frames, &written) : ESP_OK;
+        if (res != ESP_OK) ESP_LOGW(TAG, "i2s_write: %s", esp_err_to_name(res));
+        else if (written) cmd_audio_started();
+        started = true;
+
+        bool eof = false;
+        if (!pcm_frames && slot_off >= slot->len) {
+            eof = slot->eof;
+            xQueueSend(rd_free_q, &idx, 0);
+            slot = NULL;
+        }
+
+        if (!chain_checked) {
+            chain_checked = true;
+            noor_wav_info_t ninfo;
+            const decoder_t *ndec;
+            FILE *nf = next_fn(&cur, &next) ? stream_open(&next, &ninfo, &ndec) : NULL;
+            if (nf) {
+                sd_reader_append(nf, ninfo.data_offset, ninfo.data_size ? ninfo.data_size : UINT32_MAX, stream_unit_bytes(ndec, &ninfo), (uint8_t)(cur_seq + 1));
+                next_info = ninfo;
+                next_dec = ndec;
+                chained = true;
+            }
+        }
+        if (eof && !chained) {
+            if (!mix_voice_active()) break;
+            story_done = true;
+        }
+    }
+
+    mix_voice_stop();
+    dma_watch_stop();
+    if (pausable && cur.track >= 0) {
+        // interrupted: keep the position for the next PLAY; finished: start over next time
+        if (interrupted) stream_note_pos(&cur, dec, &winfo, pos);
+        else resume_set(cur.path, 0);
+        resume_flush(true);
+    }
+    if (slot) xQueueSend(rd_free_q, &idx, 0);
+    sd_reader_cancel();
+    // interrupted: discard queued tail; finished: DMA drains naturally, then auto-clear keeps it silent
+    if (interrupted) audio_out_flush();
+    noor_audio_stats_t st;
+    get_audio_stats(&st);
+    uint32_t underruns = st.ring_underruns + st.dma_underruns - underruns_before;
+    trace_evt(TR_STREAM_END, interrupted, underruns);
+    if (underruns) ESP_LOGW(TAG, "stream %s: %u underruns in %u DMA buffers (ring=%u dma=%u total, worst read %u us)", cur.path,
+                            (unsigned)underruns, (unsigned)(st.dma_buffers - buffers_before), (unsigned)st.ring_underruns,
+                            (unsigned)st.dma_underruns, (unsigned)st.max_read_us);
+    return true;
+}
+
+static bool stream_file_interruptible(const char *fullpath, noor_wav_info_t *meta, bool interruptible, bool pausable) {
+    stream_src_t src = { .path = fullpath, .meta = meta, .track = -1 };
+    return stream_session(&src, NULL, interruptible, pausable);
+}
+
+/* ---------- Announcement playback ---------- */
+// Same control semantics as stream_file_interruptible, but the samples come from PSRAM.
+static bool stream_cached_clip(const ann_clip_t *clip, bool interruptible, bool pausable) {
+    static int16_t chunk[NOOR_CONV_OUT_FRAMES * 2] __attribute__((aligned(AUDIO_BUF_ALIGN)));   // gain works on a copy, never on the cache
+    const uint16_t ch = clip->info.channels;
+    const int16_t *src = (const int16_t *)clip->pcm;
+    size_t frames_left = clip->bytes / (ch * sizeof(int16_t));
+    noor_conv_t conv;
+    noor_conv_setup(&conv, &clip->info, true);
+    int32_t gain_q15 = noor_volume_to_q15(g_volume_percent);
+    while (frames_left) {
+        uint32_t seek_ms;   // clips are not seekable; stream_poll only seeks pausable streams
+        if (stream_poll(interruptible, pausable, &seek_ms) == CTL_END) { audio_out_flush(); dma_watch_stop(); return true; }
+        size_t n, used;
+        if (conv.passthrough) {
+            n = used = (frames_left < NOOR_CONV_OUT_FRAMES) ? frames_left : NOOR_CONV_OUT_FRAMES;
+            memcpy(chunk, src, n * 2 * sizeof(int16_t));
+        } else {
+            n = noor_conv_run(&conv, src, frames_left, &used, chunk, NOOR_CONV_OUT_FRAMES);
+        }
+        src += used * ch;
+        frames_left -= used;
+        noor_gain_apply(chunk, n, 2, &gain_q15, noor_volume_to_q15(g_volume_percent));
+        size_t written = 0;
+        esp_err_t res = n ? audio_write(chunk, n, &written) : ESP_OK;
+        if (res != ESP_OK) ESP_LOGW(TAG, "i2s_write: %s", esp_err_to_name(res));
+        else if (written) cmd_audio_started();
+    }
+    dma_watch_stop();
+    return true;
+}
+
+// Announcements go through the cache; clips that do not fit stream from SD as before.
+static bool play_announcement(const char *path, bool interruptible) {
+    const ann_clip_t *clip = ann_cache_get(path);
+    if (clip) return stream_cached_clip(clip, interruptible, false);
+    return stream_file_interruptible(path, NULL, interruptible, false);
+}
+
+/* ---------- Audio task (command consumer) ---------- */
+// STOP with release (noor_audio_release_files): the stream has ended, so the reader only has
+// cancelled requests left and closes them at its next check. Cached clips go too: the same path may
+// name a different file once another card is mounted.
+static void engine_release_files(void) {
+    sd_reader_cancel();
+    while (atomic_load(&rd_files) > 0) vTaskDelay(1);
+    for (int i = 0; i < ANN_CACHE_SLOTS; ++i) if (ann_cache[i].path) ann_cache_drop(&ann_cache[i]);
+    ann_preload_n = ann_preload_next = 0;   // ids of the old card's clips
+    resume_flush(true);
+    ESP_LOGI(TAG, "files released");
+}
+
+// Resolve track idx through the app. Its entries stay put until the next STOP barrier.
+static bool engine_track(int idx, stream_src_t *src) {
+    noor_source_t s = { 0 };
+    if (!eng_cfg.track || !eng_cfg.track(idx, &s, eng_cfg.ctx) || !s.path) return false;
+    *src = (stream_src_t){ .path = s.path, .meta = s.meta, .track = idx };
+    return true;
+}
+
+// Auto-advance: a finished track continues with the next one in the folder (story series).
+static bool next_track_source(const stream_src_t *cur, stream_src_t *next) {
+    if (!g_auto_advance || cur->track < 0) return false;
+    return engine_track(cur->track + 1, next);
+}
+
+// PLAY: run the track (and whatever auto-advance chains after it) until it ends or a command interrupts it.
+static void engine_play(const audio_cmd_t *c) {
+    int idx = c->value;
+    stream_src_t src;
+    if (!engine_track(idx, &src)) { ESP_LOGW(TAG, "Audio_task: invalid play index %d", idx); return; }
+    cmd_arm(c);
+    g_playing = true;
+    g_pause = false;
+    while (idx >= 0) {
+        playing_track = idx;
+        if (!engine_track(idx, &src)) break;
+        src.start_ms = resume_start_ms(src.path);
+        ESP_LOGI(TAG, "Audio_task: cmd #%u play track %d -> %s", (unsigned)c->seq, idx, src.path);
+        stream_session(&src, next_track_source, true, true);
+        if (eng_has_next) {
+            ESP_LOGI(TAG, "Audio_task: playback interrupted");
+            break;
+        }
+        ESP_LOGI(TAG, "Audio_task: playback finished for track %d", playing_track);
+        // chained tracks already played inside the session; only a format change or a bad file lands here
+        stream_src_t nxt;
+        src.track = playing_track;
+        idx = next_track_source(&src, &nxt) ? nxt.track : -1;
+        if (idx >= 0) engine_notify_playback(idx);
+    }
+    g_playing = false;
+    g_pause = false;
+    playing_track = -1;
+    engine_notify_playback(-1);
+}
+
+// Sole consumer of the command ring. A command that interrupted a stream is run first.
+static void audio_task(void *arg) {
+    ESP_LOGI(TAG, "audio_task started (waiting for commands)");
+    while (1) {
+        audio_cmd_t c;
+        if (eng_has_next) {
+            c = eng_next;
+            eng_has_next = false;
+            if (c.type == CMD_ANNOUNCE_NEXT) c.t_us = esp_timer_get_time();   // it waited for the clip before it on purpose
+        } else if (!cmd_pop(&c)) {
+            if (ann_preload_step()) continue;   // one clip per pass: a command posted meanwhile goes first
+            // stay clocked for PM_IDLE_DELAY_MS so back-to-back announcements don't bounce the clocks
+            if (!ulTaskNotifyTake(pdTRUE, pm_active ? pdMS_TO_TICKS(PM_IDLE_DELAY_MS) : portMAX_DELAY)) pm_audio_active(false);
+            continue;
+        }
+        switch (c.type) {
+        case CMD_PLAY:
+            pm_audio_active(true);
+            engine_play(&c);
+            break;
+        case CMD_ANNOUNCE:
+        case CMD_ANNOUNCE_NEXT: {
+            const char *path = engine_clip_path(c.value);
+            if (!path) break;
+            ESP_LOGI(TAG, "Audio_task: cmd #%u announce %s", (unsigned)c.seq, path);
+            cmd_arm(&c);
+            pm_audio_active(true);
+            play_announcement(path, true);
+            break;
+        }
+        case CMD_PAUSE:
+        case CMD_SET_GAIN:
+        case CMD_CACHE:
+            engine_apply(&c);
+            break;
+        default:   // STOP (the stream it interrupted has already ended) and SEEK with nothing playing
+            cmd_record_latency(c.seq, c.t_us, cmd_name(c.type));
+            if (c.type == CMD_STOP && c.value) engine_release_files();
+            if (c.type == CMD_STOP && c.ack) xTaskNotifyGive(c.ack);   // list barrier ack
+            break;
+        }
+    }
+}
+
+/* ---------- Public API ---------- */
+bool noor_audio_init(const noor_audio_config_t *cfg) {
+    if (!cfg || audio_task_handle || audio_out_ready) return false;
+    eng_cfg = *cfg;
+    g_auto_advance = cfg->auto_advance;
+    cmd_ring_init();
+    bool ok = audio_out_init(cfg->pin_bck, cfg->pin_ws, cfg->pin_dout);
+    if (!ok) ESP_LOGE(TAG, "Audio output init failed - playback disabled");
+    if (!sd_reader_init()) { ESP_LOGE(TAG, "SD read-ahead init failed - playback disabled"); ok = false; }
+    pm_init();
+    if (cfg->resume) resume_init();
+    if (xTaskCreatePinnedToCore(audio_task, "audio_task", AUDIO_TASK_STACK, NULL, AUDIO_TASK_PRIO,
+                                &audio_task_handle, TASK_CORE(AUDIO_TASK_CORE)) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create audio_task");
+        audio_task_handle = NULL;
+        return false;
+    }
+    return ok;
+}
+
+bool noor_audio_output_init(const noor_audio_config_t *cfg) {
+    if (!cfg || audio_task_handle || audio_out_ready) return false;
+    return audio_out_init(cfg->pin_bck, cfg->pin_ws, cfg->pin_dout);
+}
+
+bool noor_audio_play(int track)       { return audio_cmd_send(CMD_PLAY, track, NULL); }
+bool noor_audio_announce(int clip_id) { return audio_cmd_send(CMD_ANNOUNCE, clip_id, NULL); }
+bool noor_audio_announce_next(int clip_id) { return audio_cmd_send(CMD_ANNOUNCE_NEXT, clip_id, NULL); }
+bool noor_audio_cache(int clip_id)    { return audio_cmd_send(CMD_CACHE, clip_id, NULL); }
+bool noor_audio_pause(int mode)       { return audio_cmd_send(CMD_PAUSE, mode, NULL); }
+bool noor_audio_stop(void)            { return audio_cmd_send(CMD_STOP, 0, NULL); }
+bool noor_audio_seek(uint32_t ms)     { return audio_cmd_send(CMD_SEEK, (int32_t)ms, NULL); }
+bool noor_audio_set_gain(int percent) { return audio_cmd_send(CMD_SET_GAIN, percent, NULL); }
+
+static bool stop_barrier(bool release, uint32_t timeout_ms) {
+    if (!audio_task_handle) return true;   // no engine, nothing holds the list
+    ulTaskNotifyTake(pdTRUE, 0);            // drop a stale ack from an earlier barrier that timed out
+    if (!audio_cmd_send(CMD_STOP, release, xTaskGetCurrentTaskHandle())) return false;
+    if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeout_ms))) return true;
+    ESP_LOGW(TAG, "stop barrier timed out after %u ms", (unsigned)timeout_ms);
+    return false;
+}
+
+bool noor_audio_stop_sync(uint32_t timeout_ms)      { return stop_barrier(false, timeout_ms); }
+bool noor_audio_release_files(uint32_t timeout_ms)  { return stop_barrier(true, timeout_ms); }
+
+void noor_audio_set_auto_advance(bool on) { g_auto_advance = on; }
+bool noor_audio_is_playing(void) { return g_playing; }
+bool noor_audio_is_paused(void) { return g_pause; }
+int noor_audio_playing_track(void) { return playing_track; }
+
+bool noor_audio_play_clip(const char *path) {
+    if (!path || !audio_out_ready) return false;
+    pm_audio_active(true);
+    bool ok = play_announcement(path, false);
+    // left active: audio_task drops the clocks after PM_IDLE_DELAY_MS without commands
+    if (audio_task_handle) xTaskNotifyGive(audio_task_handle);
+    return ok;
+}
+
+void noor_audio_cache_clip(const char *path) {
+    if (path) ann_cache_get(path);
+}
+
+void noor_audio_get_stats(noor_audio_stats_t *out) { get_audio_stats(out); }
+
+static void stats_print_hist(const char *name, const us_hist_t *h) {
+    if (!h->count) { printf("  %-17s -\n", name); return; }
+    printf("  %-17s n=%u avg=%u max=%u us |", name, (unsigned)h->count, (unsigned)(h->sum_us / h->count), (unsigned)h->max_us);
+    for (int b = 0; b < STATS_HIST_BUCKETS; ++b) {
+        if (!h->n[b]) continue;
+        if (b == STATS_HIST_BUCKETS - 1) printf(" >=%u:%u", 1u << b, (unsigned)h->n[b]);
+        else printf(" <%u:%u", 2u << b, (unsigned)h->n[b]);
+    }
+    printf("\n");
+}
+
+static void stats_print_trace(void) {
+    static const char *const kinds[] = { "?", "ring underrun #", "dma underrun #", "slow read us", "cmd->audio us", "stream start track", "stream end underruns" };
+    unsigned head = atomic_load(&stats_trace_head);
+    unsigned n = head < STATS_TRACE_LEN ? head : STATS_TRACE_LEN;
+    printf("recent events (%u of %u):\n", n, head);
+    for (unsigned i = head - n; i != head; ++i) {
+        const trace_evt_t *e = &stats_trace[i % STATS_TRACE_LEN];
+        const char *k = e->kind < sizeof(kinds) / sizeof(kinds[0]) ? kinds[e->kind] : "?";
+        if (e->kind == TR_STREAM_START) printf("  %8u ms  %s %d\n", (unsigned)e->t_ms, k, (int)e->val);
+        else printf("  %8u ms  %s %u (arg %u)\n", (unsigned)e->t_ms, k, (unsigned)e->val, e->arg);
+    }
+}
+
+void noor_audio_print_stats(void) {
+    static const char *const hist_names[HIST_COUNT] = { "sd read/slot", "i2s_write block", "announce->audio", "play/seek->audio", "cmd applied" };
+    noor_audio_stats_t st;
+    get_audio_stats(&st);
+    printf("engine: underruns ring=%u dma=%u, slots read=%u (worst %u us), cmds handled=%u dropped=%u, last cmd %u us (worst %u)\n",
+           (unsigned)st.ring_underruns, (unsigned)st.dma_underruns, (unsigned)st.slots_read, (unsigned)st.max_read_us,
+           (unsigned)st.cmd_handled, (unsigned)st.cmd_dropped, (unsigned)st.cmd_lat_last_us, (unsigned)st.cmd_lat_max_us);
+    printf("deadlines: %u DMA buffers of %u frames, %u missed (%.4f%%)\n", (unsigned)st.dma_buffers, (unsigned)I2S_DMA_BUF_LEN,
+           (unsigned)st.dma_underruns, st.dma_buffers ? 100.0 * st.dma_underruns / st.dma_buffers : 0.0);
+    printf("clocks: active %u ms, idle %u ms, %u activations; announcement cache %u hits, %u misses\n",
+           (unsigned)(st.active_us / 1000), (unsigned)(st.idle_us / 1000), (unsigned)st.activations,
+           (unsigned)ann_cache_hits, (unsigned)ann_cache_misses);
+    printf("latency (bucket upper bound us:count):\n");
+    for (int i = 0; i < HIST_COUNT; ++i) stats_print_hist(hist_names[i], &stats_hist[i]);
+    stats_print_trace();
+}
+
+void noor_audio_reset_stats(void) {
+    memset(stats_hist, 0, sizeof(stats_hist));
+    atomic_store(&stats_trace_head, 0);
+}
@@ -0,0 +1,140 @@
+// noor_card.h
+// Noor card library: the SD side of the player, shared by every app that reads the card
+// - FATFS mount on the SDSPI host (SPI2) or the S3's native SDMMC host in 1- or 4-bit mode
+// - Per-list name arenas (no malloc per entry) and natural ordering (S2 before S10)
+// - The catalog index: folders, tracks and parsed WAV headers in RAM, mirrored to a binary file on
+//   the card; a refresh re-reads only headers whose file changed size or FAT date/time
+// - Folder and track listings by readdir or from the catalog, and single header reads
+//
+// Nothing here keeps state between calls: the app owns its catalogs, arenas and lists and passes
+// them in, along with its list caps.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include "esp_err.h"
+#include "sdmmc_cmd.h"
+#include "noor_audio.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NOOR_CARD_PATH_MAX 256   // longest dir/name built on the stack; longer entries are skipped
+
+/* ---------- Mount ---------- */
+typedef struct {
+    const char *mount_point;
+    int freq_khz;                 // upper bound; the card still negotiates down if it cannot keep up
+    int max_files;
+    bool status_check;            // FATFS asks the card (CMD13) before each access: no card-detect switch
+    int sdmmc_width;              // 0: SDSPI on SPI2; 1 or 4: SDMMC host through the GPIO matrix
+    int pin_clk, pin_cmd, pin_d0, pin_d1, pin_d2, pin_d3;   // SDMMC; d1..d3 only in 4-bit mode
+    int pin_miso, pin_mosi, pin_sclk, pin_cs;                // SDSPI
+    int spi_max_transfer;         // bytes per SPI DMA transaction
+} noor_card_config_t;
+
+// Bring up the bus and mount FATFS at cfg->mount_point; *out is the card on success.
+esp_err_t noor_card_mount(const noor_card_config_t *cfg, sdmmc_card_t **out);
+// Unmount and release the bus. Everything that pointed into the volume must be closed first.
+esp_err_t noor_card_unmount(const noor_card_config_t *cfg, sdmmc_card_t *card);
+
+/* ---------- Paths and names ---------- */
+// Build dir/name into a caller buffer (for short-lived paths); false if it does not fit.
+bool noor_join_path(char *out, size_t out_len, const char *dir, const char *name);
+const char *noor_base_name(const char *path);
+// Natural order: digit runs compare by value (S2 < S10, S01 == S1), everything else case-insensitively.
+int noor_natural_cmp(const char *a, const char *b);
+// Sort full paths by their base names in natural order.
+void noor_sort_paths(char **paths, int n);
+bool noor_has_wav_ext(const char *name);
+// Is e (read from dir) of type DT_DIR / DT_REG? FATFS fills d_type; stat() only covers DT_UNKNOWN.
+bool noor_dirent_is(const char *dir, const struct dirent *e, int type);
+
+/* ---------- Name arenas ---------- */
+// List entries point into a per-list arena: no malloc per entry, and a rescan resets it in O(1).
+typedef struct {
+    char *base;
+    size_t cap;
+    size_t used;
+} noor_name_arena_t;
+
+// psram: try PSRAM first, fall back to internal RAM.
+bool noor_arena_init(noor_name_arena_t *a, size_t cap, bool psram);
+static inline void noor_arena_reset(noor_name_arena_t *a) { a->used = 0; }
+// Copy "dir/name" into the arena; NULL once the arena is full (treated like hitting the list cap).
+char *noor_arena_path(noor_name_arena_t *a, const char *dir, const char *name);
+
+/* ---------- Catalog index ---------- */
+typedef struct {
+    uint32_t name_off;            // folder name (relative to the root) in the string pool
+    uint32_t sig;                 // over the folder's WAV names, sizes and FAT times when it was listed
+    uint16_t first_track;
+    uint16_t num_tracks;
+} noor_cat_folder_t;
+
+typedef struct {
+    uint32_t name_off;            // file name (relative to its folder)
+    uint32_t mtime;               // FAT date/time when the header was read
+    noor_wav_info_t info;         // sample_rate == 0 if the header could not be parsed; info.file_size is the size it was read at
+} noor_cat_track_t;
+
+typedef struct {
+    noor_cat_folder_t *folders;
+    noor_cat_track_t *tracks;
+    char *strings;
+    uint16_t num_folders;
+    uint32_t num_tracks;
+    uint32_t strings_bytes;
+    uint32_t root_sig;
+    // list caps and capacities while building; the capacities are 0 when the arrays point into a loaded image
+    uint16_t max_folders, max_tracks;
+    uint16_t folders_cap;
+    uint32_t tracks_cap, strings_cap;
+    void *image;                  // single allocation backing a catalog loaded from the card
+} noor_catalog_t;
+
+// Identifies one version of an index file without reading its body.
+typedef struct {
+    bool present;
+    off_t size;
+    time_t mtime;
+    uint32_t crc;                 // header CRC over the catalog body
+} noor_cat_stamp_t;
+
+void noor_catalog_free(noor_catalog_t *c);
+// Bring *cat in line with the folders under root: start from seed (taken over) or, without one, from
+// the index file at index_path; re-list every folder with one stat per WAV, re-read only the headers
+// of files that are new or changed size or FAT date/time, and write the index back if anything
+// changed. At most max_folders folders and max_tracks tracks per folder are kept. false (and *cat
+// untouched) if root cannot be listed.
+bool noor_catalog_refresh(noor_catalog_t *cat, const char *root, const char *index_path, noor_catalog_t *seed,
+                          int max_folders, int max_tracks);
+static inline const char *noor_cat_str(const noor_catalog_t *c, uint32_t off) { return c->strings + off; }
+const noor_cat_folder_t *noor_cat_find_folder(const noor_catalog_t *c, const char *name);
+noor_cat_stamp_t noor_catalog_stamp(const char *index_path);
+bool noor_cat_stamp_eq(const noor_cat_stamp_t *a, const noor_cat_stamp_t *b);
+
+/* ---------- Listing ---------- */
+typedef struct {
+    char *path;                   // in the arena passed to noor_list_tracks()
+    const noor_wav_info_t *info;  // catalog header, or NULL when the file still has to be read
+} noor_track_ent_t;
+
+// The folder's WAVs, naturally sorted, into ents[0..cap): from fo (an entry of catalog c) when the
+// folder is indexed, else by readdir. *skipped counts what did not fit. -1 if the folder cannot be opened.
+int noor_list_tracks(const char *folder, const noor_catalog_t *c, const noor_cat_folder_t *fo,
+                     noor_name_arena_t *arena, noor_track_ent_t *ents, int cap, int *skipped);
+// Sub-folders of root in readdir order (hidden ones skipped, as in the catalog). -1 if root cannot be opened.
+int noor_list_folders(const char *root, noor_name_arena_t *arena, char **paths, int cap, int *skipped);
+// Open, parse and close one file; info is zeroed when it cannot be parsed.
+void noor_read_header(const char *path, noor_wav_info_t *info);
+
+#ifdef __cplusplus
+}
+#endif
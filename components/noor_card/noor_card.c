@@ -0,0 +1,481 @@
+// noor_card.c
+// Noor card library (see noor_card.h): SD mount, name arenas, the catalog index and listings.
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_rom_crc.h"
+#include "esp_vfs_fat.h"
+#include "driver/spi_common.h"
+#include "driver/sdspi_host.h"
+#include "driver/sdmmc_host.h"
+#include "noor_card.h"
+
+static const char *TAG = "noor_card";
+
+#define CATALOG_MAGIC     0x5844494Eu   // "NIDX"
+#define CATALOG_VERSION   3   // 2: ADPCM durations, 3: per-track size and FAT time
+
+/* ---------- Mount ---------- */
+// One host per mount: the SDSPI host on SPI2, or the native SDMMC host in 1- or 4-bit mode through
+// the GPIO matrix. freq_khz caps the clock for either.
+esp_err_t noor_card_mount(const noor_card_config_t *cfg, sdmmc_card_t **out) {
+    esp_vfs_fat_mount_config_t mount_cfg = {
+        .format_if_mount_failed = false,
+        .max_files = cfg->max_files,
+        .allocation_unit_size = 16 * 1024,
+        .disk_status_check_enable = cfg->status_check,
+    };
+    if (cfg->sdmmc_width) {
+        sdmmc_host_t host = SDMMC_HOST_DEFAULT();
+        host.max_freq_khz = cfg->freq_khz;
+        sdmmc_slot_config_t slot_cfg = SDMMC_SLOT_CONFIG_DEFAULT();
+        slot_cfg.width = cfg->sdmmc_width;
+        slot_cfg.clk = cfg->pin_clk;
+        slot_cfg.cmd = cfg->pin_cmd;
+        slot_cfg.d0 = cfg->pin_d0;
+        if (cfg->sdmmc_width == 4) {
+            slot_cfg.d1 = cfg->pin_d1;
+            slot_cfg.d2 = cfg->pin_d2;
+            slot_cfg.d3 = cfg->pin_d3;
+        }
+        slot_cfg.flags |= SDMMC_SLOT_FLAG_INTERNAL_PULLUP;   // boards without external pull-ups still mount (slowly)
+        ESP_LOGI(TAG, "SD: SDMMC %d-bit, up to %d kHz", cfg->sdmmc_width, cfg->freq_khz);
+        return esp_vfs_fat_sdmmc_mount(cfg->mount_point, &host, &slot_cfg, &mount_cfg, out);
+    }
+    spi_bus_config_t bus_cfg = {
+        .mosi_io_num = cfg->pin_mosi,
+        .miso_io_num = cfg->pin_miso,
+        .sclk_io_num = cfg->pin_sclk,
+        .quadwp_io_num = -1,
+        .quadhd_io_num = -1,
+        .max_transfer_sz = cfg->spi_max_transfer
+    };
+    esp_err_t r = spi_bus_initialize(SPI2_HOST, &bus_cfg, SPI_DMA_CH_AUTO);
+    if (r != ESP_OK) { ESP_LOGE(TAG, "spi_bus_initialize failed: %s", esp_err_to_name(r)); return r; }
+    sdmmc_host_t host = SDSPI_HOST_DEFAULT();
+    host.max_freq_khz = cfg->freq_khz;
+    sdspi_device_config_t slot_cfg = SDSPI_DEVICE_CONFIG_DEFAULT();
+    slot_cfg.gpio_cs = cfg->pin_cs;
+    slot_cfg.host_id = SPI2_HOST;
+    ESP_LOGI(TAG, "SD: SPI, up to %d kHz, %d-byte transfers", cfg->freq_khz, cfg->spi_max_transfer);
+    r = esp_vfs_fat_sdspi_mount(cfg->mount_point, &host, &slot_cfg, &mount_cfg, out);
+    if (r != ESP_OK) spi_bus_free(SPI2_HOST);
+    return r;
+}
+
+esp_err_t noor_card_unmount(const noor_card_config_t *cfg, sdmmc_card_t *card) {
+    esp_err_t r = esp_vfs_fat_sdcard_unmount(cfg->mount_point, card);
+    if (!cfg->sdmmc_width) spi_bus_free(SPI2_HOST);
+    return r;
+}
+
+/* ---------- Paths and names ---------- */
+bool noor_join_path(char *out, size_t out_len, const char *dir, const char *name) {
+    int n = snprintf(out, out_len, "%s/%s", dir, name);
+    return n > 0 && (size_t)n < out_len;
+}
+
+const char *noor_base_name(const char *path) {
+    const char *b = strrchr(path, '/');
+    return b ? b + 1 : path;
+}
+
+int noor_natural_cmp(const char *a, const char *b) {
+    while (*a && *b) {
+        if (isdigit((unsigned char)*a) && isdigit((unsigned char)*b)) {
+            while (*a == '0' && isdigit((unsigned char)a[1])) a++;
+            while (*b == '0' && isdigit((unsigned char)b[1])) b++;
+            size_t na = 0, nb = 0;
+            while (isdigit((unsigned char)a[na])) na++;
+            while (isdigit((unsigned char)b[nb])) nb++;
+            if (na != nb) return na < nb ? -1 : 1;
+            int c = strncmp(a, b, na);
+            if (c) return c;
+            a += na; b += nb;
+            continue;
+        }
+        int ca = tolower((unsigned char)*a), cb = tolower((unsigned char)*b);
+        if (ca != cb) return ca - cb;
+        a++; b++;
+    }
+    return (unsigned char)*a - (unsigned char)*b;
+}
+
+static int path_cmp(const void *a, const void *b) {
+    return noor_natural_cmp(noor_base_name(*(char * const *)a), noor_base_name(*(char * const *)b));
+}
+
+void noor_sort_paths(char **paths, int n) {
+    qsort(paths, n, sizeof(paths[0]), path_cmp);
+}
+
+bool noor_has_wav_ext(const char *name) {
+    size_t n = strlen(name);
+    return n > 4 && !strcasecmp(name + n - 4, ".wav");
+}
+
+bool noor_dirent_is(const char *dir, const struct dirent *e, int type) {
+    if (e->d_type == type) return true;
+    if (e->d_type != DT_UNKNOWN) return false;
+    char full[NOOR_CARD_PATH_MAX];
+    struct stat sb;
+    return noor_join_path(full, sizeof(full), dir, e->d_name) && stat(full, &sb) == 0
+           && (type == DT_DIR ? S_ISDIR(sb.st_mode) : S_ISREG(sb.st_mode));
+}
+
+/* ---------- Name arenas ---------- */
+bool noor_arena_init(noor_name_arena_t *a, size_t cap, bool psram) {
+    a->base = psram ? heap_caps_malloc(cap, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT) : NULL;
+    if (!a->base) a->base = heap_caps_malloc(cap, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    a->cap = a->base ? cap : 0;
+    a->used = 0;
+    return a->base != NULL;
+}
+
+char *noor_arena_path(noor_name_arena_t *a, const char *dir, const char *name) {
+    size_t need = strlen(dir) + 1 + strlen(name) + 1;
+    if (a->used + need > a->cap) return NULL;
+    char *p = a->base + a->used;
+    sprintf(p, "%s/%s", dir, name);
+    a->used += need;
+    return p;
+}
+
+/* ---------- Catalog index ---------- */
+// Kept in RAM (PSRAM when present) and mirrored to a binary file on the card. The file is read with
+// one fread; folder entry then never touches the directory tree. FAT does not reliably update a
+// directory's mtime when its contents change, so on refresh every folder is re-listed with one stat
+// per WAV (no malloc per entry) and each file's size and FAT date/time are compared with the ones its
+// header was read at: a story re-exported under the same name, in another rate or format, is re-read
+// even when nothing else in its folder moved. Unchanged files are never opened.
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t track_rec_bytes;    // sizeof(noor_cat_track_t), guards against layout changes between builds
+    uint32_t root_sig;
+    uint16_t num_folders;
+    uint16_t reserved;
+    uint32_t num_tracks;
+    uint32_t strings_bytes;
+    uint32_t crc;                // over everything after the header
+} cat_header_t;
+
+static void *cat_alloc(size_t bytes) {
+    void *p = heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    return p ? p : malloc(bytes);
+}
+
+static void *cat_grow(void *p, size_t bytes) {
+    void *n = heap_caps_realloc(p, bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    return n ? n : realloc(p, bytes);
+}
+
+void noor_catalog_free(noor_catalog_t *c) {
+    if (c->image) free(c->image);
+    else { free(c->folders); free(c->tracks); free(c->strings); }
+    memset(c, 0, sizeof(*c));
+}
+
+static bool cat_add_string(noor_catalog_t *c, const char *s, uint32_t *off) {
+    size_t n = strlen(s) + 1;
+    if (c->strings_bytes + n > c->strings_cap) {
+        uint32_t cap = c->strings_cap ? c->strings_cap * 2 : 1024;
+        while (cap < c->strings_bytes + n) cap *= 2;
+        char *p = cat_grow(c->strings, cap);
+        if (!p) return false;
+        c->strings = p; c->strings_cap = cap;
+    }
+    memcpy(c->strings + c->strings_bytes, s, n);
+    *off = c->strings_bytes;
+    c->strings_bytes += n;
+    return true;
+}
+
+static noor_cat_folder_t *cat_add_folder(noor_catalog_t *c, const char *name, uint32_t sig) {
+    if (c->num_folders >= c->max_folders) return NULL;
+    if (c->num_folders == c->folders_cap) {
+        uint16_t cap = c->folders_cap ? c->folders_cap * 2 : 8;
+        noor_cat_folder_t *p = cat_grow(c->folders, cap * sizeof(noor_cat_folder_t));
+        if (!p) return NULL;
+        c->folders = p; c->folders_cap = cap;
+    }
+    noor_cat_folder_t *fo = &c->folders[c->num_folders];
+    if (!cat_add_string(c, name, &fo->name_off)) return NULL;
+    fo->sig = sig;
+    fo->first_track = (uint16_t)c->num_tracks;
+    fo->num_tracks = 0;
+    c->num_folders++;
+    return fo;
+}
+
+// Appends to the last folder added.
+static bool cat_add_track(noor_catalog_t *c, const char *name, uint32_t mtime, const noor_wav_info_t *info) {
+    noor_cat_folder_t *fo = &c->folders[c->num_folders - 1];
+    if (fo->num_tracks >= c->max_tracks || c->num_tracks >= UINT16_MAX) return false;
+    if (c->num_tracks == c->tracks_cap) {
+        uint32_t cap = c->tracks_cap ? c->tracks_cap * 2 : 32;
+        noor_cat_track_t *p = cat_grow(c->tracks, cap * sizeof(noor_cat_track_t));
+        if (!p) return false;
+        c->tracks = p; c->tracks_cap = cap;
+    }
+    noor_cat_track_t *t = &c->tracks[c->num_tracks];
+    if (!cat_add_string(c, name, &t->name_off)) return false;
+    t->mtime = mtime;
+    t->info = *info;
+    c->num_tracks++;
+    fo->num_tracks++;
+    return true;
+}
+
+const noor_cat_folder_t *noor_cat_find_folder(const noor_catalog_t *c, const char *name) {
+    for (int i = 0; i < c->num_folders; ++i) {
+        if (!strcmp(noor_cat_str(c, c->folders[i].name_off), name)) return &c->folders[i];
+    }
+    return NULL;
+}
+
+static inline uint32_t fnv1a(uint32_t h, const void *p, size_t n) {
+    for (const uint8_t *b = p; n--; ++b) { h ^= *b; h *= 16777619u; }
+    return h;
+}
+
+// Order-independent signature of a directory's sub-folder names.
+static bool dir_signature(const char *path, uint32_t *sig_out) {
+    DIR *d = opendir(path);
+    if (!d) return false;
+    uint32_t sig = 0, count = 0;
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL) {
+        if (e->d_name[0] == '.' || !noor_dirent_is(path, e, DT_DIR)) continue;
+        sig += fnv1a(2166136261u, e->d_name, strlen(e->d_name));   // summed so readdir order does not matter
+        count++;
+    }
+    closedir(d);
+    *sig_out = sig ^ (count * 0x9E3779B9u);
+    return true;
+}
+
+// Track called name in prev (a folder of old), searched from *hint on: readdir order rarely changes.
+static const noor_cat_track_t *cat_find_track(const noor_catalog_t *old, const noor_cat_folder_t *prev, const char *name, int *hint) {
+    for (int k = 0; k < prev->num_tracks; ++k) {
+        int i = (*hint + k) % prev->num_tracks;
+        const noor_cat_track_t *t = &old->tracks[prev->first_track + i];
+        if (!strcmp(noor_cat_str(old, t->name_off), name)) { *hint = i + 1; return t; }
+    }
+    return NULL;
+}
+
+// List one folder with a stat per WAV. A track whose size and FAT date/time still match its entry in
+// prev (the same folder in old, or NULL) keeps that header; every other one is opened and parsed.
+// The folder's signature covers each name, size and time; *reread counts the headers read.
+static bool cat_scan_folder(noor_catalog_t *c, const char *root, const char *name,
+                            const noor_catalog_t *old, const noor_cat_folder_t *prev, int *reread) {
+    char dir[NOOR_CARD_PATH_MAX];
+    if (!noor_join_path(dir, sizeof(dir), root, name)) return false;
+    DIR *d = opendir(dir);
+    if (!d) return false;
+    noor_cat_folder_t *fo = cat_add_folder(c, name, 0);   // stays put: only cat_add_folder moves the array
+    if (!fo) { closedir(d); return false; }
+    uint32_t sig = 0, count = 0;
+    int hint = 0;
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL) {
+        if (e->d_name[0] == '.' || e->d_type == DT_DIR || !noor_has_wav_ext(e->d_name)) continue;
+        char full[NOOR_CARD_PATH_MAX];
+        struct stat sb;
+        if (!noor_join_path(full, sizeof(full), dir, e->d_name) || stat(full, &sb) != 0 || !S_ISREG(sb.st_mode)) continue;
+        const uint32_t size = (uint32_t)sb.st_size, mtime = (uint32_t)sb.st_mtime;
+        uint32_t h = fnv1a(2166136261u, e->d_name, strlen(e->d_name));
+        h = fnv1a(fnv1a(h, &size, sizeof(size)), &mtime, sizeof(mtime));
+        const noor_cat_track_t *t = prev ? cat_find_track(old, prev, e->d_name, &hint) : NULL;
+        noor_wav_info_t info;
+        if (t && t->info.file_size == size && t->mtime == mtime) {
+            info = t->info;   // unchanged since its header was read: not opened
+        } else {
+            noor_read_header(full, &info);
+            info.file_size = size;   // also for a header that did not parse, so it is not retried every refresh
+            (*reread)++;
+        }
+        if (!cat_add_track(c, e->d_name, mtime, &info)) { ESP_LOGW(TAG, "%s: more than %d WAV files, rest not indexed", dir, c->max_tracks); break; }
+        sig += h;
+        count++;
+    }
+    closedir(d);
+    fo->sig = sig ^ (count * 0x9E3779B9u);
+    return true;
+}
+
+static uint32_t cat_crc(const noor_catalog_t *c) {
+    uint32_t crc = esp_rom_crc32_le(0, (const uint8_t *)c->folders, c->num_folders * sizeof(noor_cat_folder_t));
+    crc = esp_rom_crc32_le(crc, (const uint8_t *)c->tracks, c->num_tracks * sizeof(noor_cat_track_t));
+    return esp_rom_crc32_le(crc, (const uint8_t *)c->strings, c->strings_bytes);
+}
+
+static bool catalog_load(const char *path, noor_catalog_t *out, int max_folders) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return false;
+    struct stat sb;
+    cat_header_t h;
+    bool ok = fstat(fileno(f), &sb) == 0 && sb.st_size > (off_t)sizeof(h) && fread(&h, 1, sizeof(h), f) == sizeof(h)
+              && h.magic == CATALOG_MAGIC && h.version == CATALOG_VERSION && h.track_rec_bytes == sizeof(noor_cat_track_t)
+              && h.num_folders <= max_folders
+              && (off_t)(sizeof(h) + h.num_folders * sizeof(noor_cat_folder_t) + h.num_tracks * sizeof(noor_cat_track_t) + h.strings_bytes) == sb.st_size;
+    uint8_t *img = NULL;
+    size_t body = ok ? (size_t)sb.st_size - sizeof(h) : 0;
+    if (ok) ok = (img = cat_alloc(body)) != NULL;
+    if (ok) ok = fread(img, 1, body, f) == body;   // one read for the whole catalog
+    fclose(f);
+    if (!ok) { free(img); return false; }
+    memset(out, 0, sizeof(*out));
+    out->image = img;
+    out->folders = (noor_cat_folder_t *)img;
+    out->tracks = (noor_cat_track_t *)(img + h.num_folders * sizeof(noor_cat_folder_t));
+    out->strings = (char *)(img + h.num_folders * sizeof(noor_cat_folder_t) + h.num_tracks * sizeof(noor_cat_track_t));
+    out->num_folders = h.num_folders;
+    out->num_tracks = h.num_tracks;
+    out->strings_bytes = h.strings_bytes;
+    out->root_sig = h.root_sig;
+    if (cat_crc(out) != h.crc || (h.strings_bytes && out->strings[h.strings_bytes - 1] != '\0')) {
+        ESP_LOGW(TAG, "Catalog %s corrupt, rebuilding", path);
+        noor_catalog_free(out);
+        return false;
+    }
+    return true;
+}
+
+static bool catalog_save(const char *path, const noor_catalog_t *c) {
+    char tmp[NOOR_CARD_PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "wb");
+    if (!f) { ESP_LOGW(TAG, "Cannot write %s", tmp); return false; }
+    cat_header_t h = {
+        .magic = CATALOG_MAGIC, .version = CATALOG_VERSION, .track_rec_bytes = sizeof(noor_cat_track_t),
+        .root_sig = c->root_sig, .num_folders = c->num_folders, .num_tracks = c->num_tracks,
+        .strings_bytes = c->strings_bytes, .crc = cat_crc(c)
+    };
+    bool ok = fwrite(&h, 1, sizeof(h), f) == sizeof(h)
+              && fwrite(c->folders, sizeof(noor_cat_folder_t), c->num_folders, f) == c->num_folders
+              && fwrite(c->tracks, sizeof(noor_cat_track_t), c->num_tracks, f) == c->num_tracks
+              && fwrite(c->strings, 1, c->strings_bytes, f) == c->strings_bytes;
+    ok = (fclose(f) == 0) && ok;
+    // FAT rename does not replace an existing file
+    if (ok) { unlink(path); ok = rename(tmp, path) == 0; }
+    if (!ok) { unlink(tmp); ESP_LOGW(TAG, "Catalog write failed"); }
+    return ok;
+}
+
+bool noor_catalog_refresh(noor_catalog_t *cat, const char *root, const char *index_path, noor_catalog_t *seed,
+                          int max_folders, int max_tracks) {
+    int64_t t0 = esp_timer_get_time();
+    noor_catalog_t old = {0};
+    bool have_old = true;
+    if (seed) { old = *seed; memset(seed, 0, sizeof(*seed)); }
+    else have_old = catalog_load(index_path, &old, max_folders);
+    noor_catalog_t next = { .max_folders = (uint16_t)max_folders, .max_tracks = (uint16_t)max_tracks };
+    bool dirty = !have_old;
+    int reparsed = 0;
+
+    if (!dir_signature(root, &next.root_sig)) { ESP_LOGE(TAG, "Failed to open %s", root); noor_catalog_free(&old); return false; }
+    if (have_old && old.root_sig != next.root_sig) dirty = true;
+    DIR *d = opendir(root);
+    struct dirent *e;
+    while (d && (e = readdir(d)) != NULL && next.num_folders < max_folders) {
+        if (e->d_name[0] == '.' || !noor_dirent_is(root, e, DT_DIR)) continue;
+        const noor_cat_folder_t *prev = have_old ? noor_cat_find_folder(&old, e->d_name) : NULL;
+        int before = reparsed;
+        if (!cat_scan_folder(&next, root, e->d_name, &old, prev, &reparsed)) continue;
+        const noor_cat_folder_t *fo = &next.folders[next.num_folders - 1];
+        if (reparsed != before || !prev || prev->sig != fo->sig || prev->num_tracks != fo->num_tracks) dirty = true;
+    }
+    if (d) closedir(d);
+    if (have_old && old.num_folders != next.num_folders) dirty = true;
+    noor_catalog_free(&old);
+
+    noor_catalog_free(cat);
+    *cat = next;
+    if (dirty) catalog_save(index_path, cat);
+    ESP_LOGI(TAG, "Catalog: %d folders, %u tracks, %d re-parsed%s (%lld ms)", cat->num_folders, (unsigned)cat->num_tracks,
+             reparsed, dirty ? ", saved" : "", (long long)((esp_timer_get_time() - t0) / 1000));
+    return true;
+}
+
+noor_cat_stamp_t noor_catalog_stamp(const char *index_path) {
+    noor_cat_stamp_t st = {0};
+    FILE *f = fopen(index_path, "rb");
+    if (!f) return st;
+    struct stat sb;
+    cat_header_t h;
+    st.present = fstat(fileno(f), &sb) == 0 && fread(&h, 1, sizeof(h), f) == sizeof(h);
+    fclose(f);
+    if (st.present) { st.size = sb.st_size; st.mtime = sb.st_mtime; st.crc = h.crc; }
+    return st;
+}
+
+bool noor_cat_stamp_eq(const noor_cat_stamp_t *a, const noor_cat_stamp_t *b) {
+    return a->present == b->present && a->size == b->size && a->mtime == b->mtime && a->crc == b->crc;
+}
+
+/* ---------- Listing ---------- */
+static int track_ent_cmp(const void *a, const void *b) {
+    return noor_natural_cmp(noor_base_name(((const noor_track_ent_t *)a)->path), noor_base_name(((const noor_track_ent_t *)b)->path));
+}
+
+int noor_list_tracks(const char *folder, const noor_catalog_t *c, const noor_cat_folder_t *fo,
+                     noor_name_arena_t *arena, noor_track_ent_t *ents, int cap, int *skipped) {
+    int n = 0;
+    *skipped = 0;
+    if (fo) {
+        for (int i = 0; i < fo->num_tracks; ++i) {
+            const noor_cat_track_t *t = &c->tracks[fo->first_track + i];
+            char *full = (n < cap) ? noor_arena_path(arena, folder, noor_cat_str(c, t->name_off)) : NULL;
+            if (!full) { (*skipped)++; continue; }
+            ents[n++] = (noor_track_ent_t){ full, &t->info };
+        }
+    } else {
+        DIR *d = opendir(folder);
+        if (!d) return -1;
+        struct dirent *e;
+        while ((e = readdir(d)) != NULL) {
+            if (e->d_name[0] == '.' || !noor_has_wav_ext(e->d_name) || !noor_dirent_is(folder, e, DT_REG)) continue;
+            char *full = (n < cap) ? noor_arena_path(arena, folder, e->d_name) : NULL;
+            if (!full) { (*skipped)++; continue; }
+            ents[n++] = (noor_track_ent_t){ full, NULL };
+        }
+        closedir(d);
+    }
+    qsort(ents, n, sizeof(ents[0]), track_ent_cmp);
+    return n;
+}
+
+int noor_list_folders(const char *root, noor_name_arena_t *arena, char **paths, int cap, int *skipped) {
+    int n = 0;
+    *skipped = 0;
+    DIR *d = opendir(root);
+    if (!d) return -1;
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL) {
+        if (e->d_name[0] == '.') continue;   // ".", ".." and hidden folders, as in the catalog
+        if (!noor_dirent_is(root, e, DT_DIR)) continue;
+        char *full = (n < cap) ? noor_arena_path(arena, root, e->d_name) : NULL;
+        if (!full) { (*skipped)++; continue; }
+        paths[n++] = full;
+    }
+    closedir(d);
+    return n;
+}
+
+void noor_read_header(const char *path, noor_wav_info_t *info) {
+    memset(info, 0, sizeof(*info));   // unparsed: stream_open tries again and reports the error
+    FILE *f = fopen(path, "rb");
+    if (!f) return;
+    if (!noor_wav_parse_header(f, info)) memset(info, 0, sizeof(*info));
+    fclose(f);
+}
@@ -0,0 +1,531 @@
+// bench.c
+// NOOR_BENCH: repeatable on-target measurements of the Noor player's audio and storage paths
+// - SD sequential read throughput through stdio, read() on FATFS and raw sectors, at several buffer sizes
+// - Track listing (readdir + natural sort), first/all header reads and root folder scans vs. entry count
+// - noor_wav_parse_header on a warm and a freshly opened file
+// - Gain, duck-mix, resample and rate-matched PCM kernels in cycles per output sample
+// - I2S clock reconfiguration, stop/start and DMA flush
+//
+// Card mount, listings and header reads come from components/noor_card and the sample kernels from
+// noor_audio_dsp.h, the same code the player links, so every number comes from the code that ships;
+// the "Noor player" and "Noor audio engine" menuconfig options apply as-is.
+// Each result is one line, "BENCH " followed by a JSON object, e.g.
+//   BENCH {"bench":"sd_read","path":"fread","buf":16384,"dma":true,"unit":"MB/s","min":1.9,"med":2.0,"max":2.0,"n":7}
+// `grep '^BENCH ' | cut -c7-` gives JSON lines to diff between firmware versions; the "meta" line
+// names the build, card and bus. Fixtures live in /sdcard/.noor_bench and are reused on later runs.
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_idf_version.h"
+#include "esp_app_desc.h"
+#include "esp_cpu.h"
+#include "sdmmc_cmd.h"
+#include "driver/i2s.h"
+#include "noor_audio.h"
+#include "noor_audio_dsp.h"
+#include "noor_card.h"
+
+static const char *TAG = "NOOR_BENCH";
+
+/* ---------- Pins (the player's wiring, see README) ---------- */
+#define I2S_BCK_PIN   18
+#define I2S_WS_PIN    17
+#define I2S_DO_PIN    16
+
+#define PIN_NUM_MISO 13
+#define PIN_NUM_MOSI 11
+#define PIN_NUM_CLK  12
+#define PIN_NUM_CS   10
+
+#ifdef CONFIG_NOOR_SD_SDMMC
+#define PIN_SD_CLK   CONFIG_NOOR_SD_PIN_CLK
+#define PIN_SD_CMD   CONFIG_NOOR_SD_PIN_CMD
+#define PIN_SD_D0    CONFIG_NOOR_SD_PIN_D0
+#ifdef CONFIG_NOOR_SD_SDMMC_4BIT
+#define PIN_SD_D1    CONFIG_NOOR_SD_PIN_D1
+#define PIN_SD_D2    CONFIG_NOOR_SD_PIN_D2
+#define PIN_SD_D3    CONFIG_NOOR_SD_PIN_D3
+#endif
+#endif
+
+/* ---------- Player settings ("Noor player" menu, same defaults as main.c) ---------- */
+#ifdef CONFIG_NOOR_MAX_TRACKS
+#define MAX_WAV_FILES     CONFIG_NOOR_MAX_TRACKS
+#define MAX_FOLDERS       CONFIG_NOOR_MAX_FOLDERS
+#define LIST_PATH_BYTES   CONFIG_NOOR_LIST_PATH_BYTES
+#else
+#define MAX_WAV_FILES     64
+#define MAX_FOLDERS       32
+#define LIST_PATH_BYTES   96
+#endif
+#if CONFIG_NOOR_LIST_ARENA_PSRAM
+#define LIST_ARENA_PSRAM  true
+#else
+#define LIST_ARENA_PSRAM  false
+#endif
+#define SD_MOUNT_POINT    "/sdcard"
+#ifdef CONFIG_NOOR_SD_FREQ_KHZ
+#define SD_FREQ_KHZ       CONFIG_NOOR_SD_FREQ_KHZ
+#define SD_MAX_FILES      CONFIG_NOOR_SD_MAX_FILES
+#define SD_PIN_CD         CONFIG_NOOR_SD_PIN_CD
+#else
+#define SD_FREQ_KHZ       20000
+#define SD_MAX_FILES      5
+#define SD_PIN_CD         -1
+#endif
+#ifdef CONFIG_NOOR_SD_SPI_MAX_TRANSFER
+#define SD_SPI_MAX_TRANSFER CONFIG_NOOR_SD_SPI_MAX_TRANSFER
+#else
+#define SD_SPI_MAX_TRANSFER 4000
+#endif
+#ifdef CONFIG_NOOR_SD_SDMMC_1BIT
+#define SD_SDMMC_WIDTH    1
+#else
+#define SD_SDMMC_WIDTH    4
+#endif
+
+/* ---------- Bench settings ---------- */
+#ifdef CONFIG_NOOR_BENCH_REPEAT
+#define BENCH_REPEAT      CONFIG_NOOR_BENCH_REPEAT
+#else
+#define BENCH_REPEAT      7
+#endif
+#ifdef CONFIG_NOOR_BENCH_FILE_KB
+#define BENCH_FILE_BYTES  ((size_t)CONFIG_NOOR_BENCH_FILE_KB * 1024)
+#else
+#define BENCH_FILE_BYTES  ((size_t)4096 * 1024)
+#endif
+#define BENCH_DIR         SD_MOUNT_POINT "/.noor_bench"
+#define BENCH_SEQ_FILE    BENCH_DIR "/seq.bin"
+#define BENCH_MAX_BUF     65536
+#define BENCH_WAV_DATA    4096        // payload of each fixture track
+#define BENCH_KERNEL_FRAMES NOOR_CONV_OUT_FRAMES   // the mixer works on at most this many frames
+#ifdef CONFIG_NOOR_MIX_DUCK_PERCENT
+#define BENCH_DUCK_PERCENT CONFIG_NOOR_MIX_DUCK_PERCENT
+#else
+#define BENCH_DUCK_PERCENT 25
+#endif
+
+#ifdef CONFIG_NOOR_SD_SDMMC
+#define BENCH_BUS_NAME    (SD_SDMMC_WIDTH == 4 ? "sdmmc4" : "sdmmc1")
+#else
+#define BENCH_BUS_NAME    "spi"
+#endif
+
+static const size_t bench_bufs[] = { 512, 4096, 16384, 32768, 65536 };
+
+/* ---------- Card and lists ---------- */
+static const noor_card_config_t card_cfg = {
+    .mount_point = SD_MOUNT_POINT,
+    .freq_khz = SD_FREQ_KHZ,
+    .max_files = SD_MAX_FILES,
+    .status_check = (SD_PIN_CD < 0),
+#ifdef CONFIG_NOOR_SD_SDMMC
+    .sdmmc_width = SD_SDMMC_WIDTH,
+    .pin_clk = PIN_SD_CLK, .pin_cmd = PIN_SD_CMD, .pin_d0 = PIN_SD_D0,
+#if SD_SDMMC_WIDTH == 4
+    .pin_d1 = PIN_SD_D1, .pin_d2 = PIN_SD_D2, .pin_d3 = PIN_SD_D3,
+#endif
+#endif
+    .pin_miso = PIN_NUM_MISO, .pin_mosi = PIN_NUM_MOSI, .pin_sclk = PIN_NUM_CLK, .pin_cs = PIN_NUM_CS,
+    .spi_max_transfer = SD_SPI_MAX_TRANSFER,
+};
+static sdmmc_card_t *sdcard = NULL;
+
+// Sized like the player's lists, so the arenas fill up at the same entry counts.
+static noor_name_arena_t folder_arena;
+static noor_name_arena_t wav_arena;
+static char *folder_list[MAX_FOLDERS];
+static noor_track_ent_t track_ents[MAX_WAV_FILES];
+
+static bool bench_lists_init(void) {
+    return noor_arena_init(&folder_arena, MAX_FOLDERS * LIST_PATH_BYTES, LIST_ARENA_PSRAM)
+           && noor_arena_init(&wav_arena, MAX_WAV_FILES * LIST_PATH_BYTES, LIST_ARENA_PSRAM);
+}
+
+/* ---------- Result lines ---------- */
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// params is a JSON fragment ("\"buf\":512") or ""; v holds n samples and is sorted here.
+static void bench_emit(const char *bench, const char *params, const char *unit, double *v, int n) {
+    const char *sep = *params ? "," : "";
+    if (n <= 0) { printf("BENCH {\"bench\":\"%s\"%s%s,\"error\":\"no samples\"}\n", bench, sep, params); return; }
+    qsort(v, n, sizeof(v[0]), cmp_double);
+    printf("BENCH {\"bench\":\"%s\"%s%s,\"unit\":\"%s\",\"min\":%.3f,\"med\":%.3f,\"max\":%.3f,\"n\":%d}\n",
+           bench, sep, params, unit, v[0], v[n / 2], v[n - 1], n);
+}
+
+static void bench_fail(const char *bench, const char *what) {
+    printf("BENCH {\"bench\":\"%s\",\"error\":\"%s\"}\n", bench, what);
+}
+
+static inline double ms_since(int64_t t0) { return (double)(esp_timer_get_time() - t0) / 1000.0; }
+
+static void bench_meta(void) {
+    const esp_app_desc_t *app = esp_app_get_description();
+    unsigned card_mb = (unsigned)(((uint64_t)sdcard->csd.capacity * sdcard->csd.sector_size) >> 20);
+    printf("BENCH {\"bench\":\"meta\",\"app\":\"%s\",\"version\":\"%s\",\"idf\":\"%s\",\"bus\":\"%s\",\"sd_khz\":%d,"
+           "\"card\":\"%s\",\"card_mb\":%u,\"out_rate\":%d,\"cpu_mhz\":%d,\"repeat\":%d}\n",
+           app->project_name, app->version, esp_get_idf_version(), BENCH_BUS_NAME, SD_FREQ_KHZ,
+           sdcard->cid.name, card_mb, NOOR_AUDIO_OUT_RATE, CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ, BENCH_REPEAT);
+}
+
+/* ---------- Fixtures (/sdcard/.noor_bench) ---------- */
+static void put_le(uint8_t *p, uint32_t v, int n) {
+    for (int i = 0; i < n; ++i) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+// 44.1 kHz stereo PCM with a LIST chunk before data, so the chunk walker does what it does on real files.
+static bool bench_write_wav(const char *path) {
+    uint8_t h[72];
+    memset(h, 0, sizeof(h));
+    memcpy(h, "RIFF", 4);      put_le(h + 4, sizeof(h) - 8 + BENCH_WAV_DATA, 4); memcpy(h + 8, "WAVE", 4);
+    memcpy(h + 12, "fmt ", 4); put_le(h + 16, 16, 4);
+    put_le(h + 20, NOOR_WAV_FORMAT_PCM, 2); put_le(h + 22, 2, 2); put_le(h + 24, 44100, 4);
+    put_le(h + 28, 44100 * 4, 4); put_le(h + 32, 4, 2); put_le(h + 34, 16, 2);
+    memcpy(h + 36, "LIST", 4); put_le(h + 40, 20, 4); memcpy(h + 44, "INFOISFT", 8); put_le(h + 52, 8, 4);
+    memcpy(h + 56, "noorbnch", 8);
+    memcpy(h + 64, "data", 4); put_le(h + 68, BENCH_WAV_DATA, 4);
+    FILE *f = fopen(path, "wb");
+    if (!f) return false;
+    static const uint8_t silence[BENCH_WAV_DATA];
+    bool ok = fwrite(h, 1, sizeof(h), f) == sizeof(h) && fwrite(silence, 1, sizeof(silence), f) == sizeof(silence);
+    return (fclose(f) == 0) && ok;
+}
+
+// dir with S1.wav..S<count>.wav, written highest first so readdir order is not already sorted.
+static bool bench_fixture_tracks(int count, char *dir, size_t dir_len) {
+    snprintf(dir, dir_len, BENCH_DIR "/t%d", count);
+    char p[NOOR_CARD_PATH_MAX];
+    struct stat sb;
+    snprintf(p, sizeof(p), "%s/S1.wav", dir);
+    if (stat(p, &sb) == 0) return true;   // complete from an earlier run (S1 is written last)
+    mkdir(dir, 0777);
+    for (int i = count; i >= 1; --i) {
+        snprintf(p, sizeof(p), "%s/S%d.wav", dir, i);
+        if (!bench_write_wav(p)) return false;
+    }
+    return true;
+}
+
+static bool bench_fixture_folders(int count, char *dir, size_t dir_len) {
+    snprintf(dir, dir_len, BENCH_DIR "/d%d", count);
+    char p[NOOR_CARD_PATH_MAX];
+    struct stat sb;
+    snprintf(p, sizeof(p), "%s/F1", dir);
+    if (stat(p, &sb) == 0) return true;
+    mkdir(dir, 0777);
+    for (int i = count; i >= 1; --i) {
+        snprintf(p, sizeof(p), "%s/F%d", dir, i);
+        if (mkdir(p, 0777) != 0) return false;
+    }
+    return true;
+}
+
+static bool bench_fixture_seq(uint8_t *buf, size_t buf_len) {
+    struct stat sb;
+    if (stat(BENCH_SEQ_FILE, &sb) == 0 && (size_t)sb.st_size == BENCH_FILE_BYTES) return true;
+    FILE *f = fopen(BENCH_SEQ_FILE, "wb");
+    if (!f) return false;
+    for (size_t i = 0; i < buf_len; ++i) buf[i] = (uint8_t)(i * 31);
+    bool ok = true;
+    for (size_t done = 0; ok && done < BENCH_FILE_BYTES; done += buf_len) ok = fwrite(buf, 1, buf_len, f) == buf_len;
+    return (fclose(f) == 0) && ok;
+}
+
+// Lists go up to the configured caps; smaller configs skip the rows that do not fit.
+static int bench_counts(const int *want, int n_want, int cap, int *out) {
+    int n = 0;
+    for (int i = 0; i < n_want; ++i) {
+        int c = want[i] < cap ? want[i] : cap;
+        if (!n || c > out[n - 1]) out[n++] = c;
+    }
+    return n;
+}
+
+/* ---------- SD sequential read ---------- */
+static void bench_sd_read(void) {
+    bool dma;
+    uint8_t *buf = noor_audio_buf_alloc(BENCH_MAX_BUF, &dma);   // same allocator as the read-ahead slots
+    if (!buf) { bench_fail("sd_read", "no buffer"); return; }
+    if (!bench_fixture_seq(buf, BENCH_MAX_BUF)) { bench_fail("sd_read", "fixture"); heap_caps_free(buf); return; }
+    const size_t sector = sdcard->csd.sector_size ? sdcard->csd.sector_size : 512;
+    char params[96];
+    for (size_t b = 0; b < sizeof(bench_bufs) / sizeof(bench_bufs[0]); ++b) {
+        const size_t len = bench_bufs[b];
+        double v[BENCH_REPEAT];
+        int n = 0;
+        for (int r = 0; r < BENCH_REPEAT; ++r) {
+            FILE *f = fopen(BENCH_SEQ_FILE, "rb");
+            if (!f) break;
+            size_t total = 0, got;
+            int64_t t0 = esp_timer_get_time();
+            while ((got = fread(buf, 1, len, f)) > 0) total += got;
+            int64_t us = esp_timer_get_time() - t0;
+            fclose(f);
+            if (total != BENCH_FILE_BYTES || us <= 0) break;
+            v[n++] = (double)total / (double)us;
+        }
+        snprintf(params, sizeof(params), "\"path\":\"fread\",\"buf\":%u,\"dma\":%s", (unsigned)len, dma ? "true" : "false");
+        bench_emit("sd_read", params, "MB/s", v, n);
+
+        // the read-ahead slots' path: read() on the descriptor, no stdio buffer in between
+        n = 0;
+        for (int r = 0; r < BENCH_REPEAT; ++r) {
+            FILE *f = fopen(BENCH_SEQ_FILE, "rb");
+            if (!f) break;
+            size_t total = 0;
+            ssize_t got;
+            int64_t t0 = esp_timer_get_time();
+            while ((got = read(fileno(f), buf, len)) > 0) total += (size_t)got;
+            int64_t us = esp_timer_get_time() - t0;
+            fclose(f);
+            if (total != BENCH_FILE_BYTES || us <= 0) break;
+            v[n++] = (double)total / (double)us;
+        }
+        snprintf(params, sizeof(params), "\"path\":\"read\",\"buf\":%u,\"dma\":%s", (unsigned)len, dma ? "true" : "false");
+        bench_emit("sd_read", params, "MB/s", v, n);
+
+        n = 0;
+        for (int r = 0; r < BENCH_REPEAT && len % sector == 0; ++r) {
+            size_t done = 0;
+            int64_t t0 = esp_timer_get_time();
+            for (size_t lba = 0; done < BENCH_FILE_BYTES; lba += len / sector, done += len) {
+                if (sdmmc_read_sectors(sdcard, buf, lba, len / sector) != ESP_OK) break;
+            }
+            int64_t us = esp_timer_get_time() - t0;
+            if (done < BENCH_FILE_BYTES || us <= 0) break;
+            v[n++] = (double)done / (double)us;
+        }
+        snprintf(params, sizeof(params), "\"path\":\"sectors\",\"buf\":%u,\"dma\":%s", (unsigned)len, dma ? "true" : "false");
+        bench_emit("sd_read", params, "MB/s", v, n);
+    }
+    heap_caps_free(buf);
+}
+
+/* ---------- Scans ---------- */
+// The stages the player's scan_task goes through before a folder is fully published (no catalog: readdir path).
+static void bench_scan_tracks(void) {
+    static const int want[] = { 8, 32, 128 };
+    int counts[3];
+    int nc = bench_counts(want, 3, MAX_WAV_FILES, counts);
+    char dir[64], params[64];
+    for (int i = 0; i < nc; ++i) {
+        if (!bench_fixture_tracks(counts[i], dir, sizeof(dir))) { bench_fail("scan_tracks", "fixture"); continue; }
+        double list_ms[BENCH_REPEAT], first_ms[BENCH_REPEAT], all_ms[BENCH_REPEAT];
+        int n = 0;
+        for (int r = 0; r < BENCH_REPEAT; ++r) {
+            noor_wav_info_t info;
+            int skipped = 0;
+            noor_arena_reset(&wav_arena);
+            int64_t t0 = esp_timer_get_time();
+            int got = noor_list_tracks(dir, NULL, NULL, &wav_arena, track_ents, MAX_WAV_FILES, &skipped);
+            list_ms[n] = ms_since(t0);
+            if (got != counts[i]) break;
+            noor_read_header(track_ents[0].path, &info);
+            first_ms[n] = ms_since(t0);
+            for (int k = 1; k < got; ++k) noor_read_header(track_ents[k].path, &info);
+            all_ms[n] = ms_since(t0);
+            n++;
+        }
+        snprintf(params, sizeof(params), "\"stage\":\"list_sort\",\"entries\":%d", counts[i]);
+        bench_emit("scan_tracks", params, "ms", list_ms, n);
+        snprintf(params, sizeof(params), "\"stage\":\"first_track\",\"entries\":%d", counts[i]);
+        bench_emit("scan_tracks", params, "ms", first_ms, n);
+        snprintf(params, sizeof(params), "\"stage\":\"all_headers\",\"entries\":%d", counts[i]);
+        bench_emit("scan_tracks", params, "ms", all_ms, n);
+    }
+    noor_arena_reset(&wav_arena);
+}
+
+// The listing and natural sort scan_root_folders() does at boot without a catalog (the player's
+// announcement lookup that follows it is not included).
+static void bench_scan_folders(void) {
+    static const int want[] = { 4, 16, 64 };
+    int counts[3];
+    int nc = bench_counts(want, 3, MAX_FOLDERS, counts);
+    char dir[64], params[32];
+    for (int i = 0; i < nc; ++i) {
+        if (!bench_fixture_folders(counts[i], dir, sizeof(dir))) { bench_fail("scan_folders", "fixture"); continue; }
+        double v[BENCH_REPEAT];
+        int n = 0;
+        for (int r = 0; r < BENCH_REPEAT; ++r) {
+            int skipped = 0;
+            noor_arena_reset(&folder_arena);
+            int64_t t0 = esp_timer_get_time();
+            int got = noor_list_folders(dir, &folder_arena, folder_list, MAX_FOLDERS, &skipped);
+            if (got > 0) noor_sort_paths(folder_list, got);
+            v[n] = ms_since(t0);
+            if (got != counts[i]) break;
+            n++;
+        }
+        snprintf(params, sizeof(params), "\"entries\":%d", counts[i]);
+        bench_emit("scan_folders", params, "ms", v, n);
+    }
+    noor_arena_reset(&folder_arena);
+}
+
+/* ---------- WAV header ---------- */
+static void bench_parse_header(void) {
+    char dir[64], path[NOOR_CARD_PATH_MAX];
+    if (!bench_fixture_tracks(8, dir, sizeof(dir)) || !noor_join_path(path, sizeof(path), dir, "S1.wav")) { bench_fail("parse_wav_header", "fixture"); return; }
+    double warm[BENCH_REPEAT], cold[BENCH_REPEAT];
+    int nw = 0, nc = 0;
+    FILE *f = fopen(path, "rb");
+    for (int r = 0; f && r < BENCH_REPEAT; ++r) {
+        noor_wav_info_t info;
+        fseek(f, 0, SEEK_SET);
+        int64_t t0 = esp_timer_get_time();
+        bool ok = noor_wav_parse_header(f, &info);
+        if (ok) warm[nw++] = (double)(esp_timer_get_time() - t0);
+    }
+    if (f) fclose(f);
+    for (int r = 0; r < BENCH_REPEAT; ++r) {
+        noor_wav_info_t info;
+        int64_t t0 = esp_timer_get_time();
+        noor_read_header(path, &info);   // fopen + parse + fclose, as the scan does per track
+        if (info.sample_rate) cold[nc++] = (double)(esp_timer_get_time() - t0);
+    }
+    bench_emit("parse_wav_header", "\"file\":\"open\"", "us", warm, nw);
+    bench_emit("parse_wav_header", "\"file\":\"open_parse_close\"", "us", cold, nc);
+}
+
+/* ---------- Sample kernels ---------- */
+// The volume loop from before the Q15 stage, kept only as the baseline row.
+static void gain_legacy(int16_t *p, size_t n, int vol) {
+    for (size_t i = 0; i < n; ++i) p[i] = noor_clip16(((int32_t)p[i] * vol) / 100);
+}
+
+static void bench_kernels(void) {
+    const size_t frames = BENCH_KERNEL_FRAMES, ns = frames * 2;
+    int16_t *src = heap_caps_aligned_alloc(16, ns * sizeof(int16_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    int16_t *buf = heap_caps_aligned_alloc(16, ns * sizeof(int16_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    int16_t *voice = heap_caps_aligned_alloc(16, ns * sizeof(int16_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!src || !buf || !voice) { bench_fail("kernel", "no buffer"); heap_caps_free(src); heap_caps_free(buf); heap_caps_free(voice); return; }
+    for (size_t i = 0; i < ns; ++i) src[i] = (int16_t)((i * 7919) & 0xFFFF);
+    memcpy(voice, src, ns * sizeof(int16_t));
+
+    enum { K_LEGACY, K_STEADY, K_RAMP, K_DUCK, K_RS_MONO, K_RS_STEREO, K_PCM_MONO, K_PCM_S24, K_COUNT };
+    static const char *const names[K_COUNT] = { "gain_legacy", "gain_q15", "gain_q15_ramp", "mix_ducked", "conv_22k_mono", "conv_48k_stereo",
+                                                "pcm_s16_mono_gain", "pcm_s24_stereo_gain" };
+    double v[K_COUNT][BENCH_REPEAT];
+    const noor_wav_info_t mono22 = { .sample_rate = 22050, .channels = 1, .bits_per_sample = 16 };
+    const noor_wav_info_t st48 = { .sample_rate = 48000, .channels = 2, .bits_per_sample = 16 };
+    const noor_pcm_kernel_t *k_mono = noor_pcm_kernel_for(&(noor_wav_info_t){ .format = NOOR_WAV_FORMAT_PCM, .sample_rate = NOOR_AUDIO_OUT_RATE, .channels = 1, .bits_per_sample = 16 });
+    const noor_pcm_kernel_t *k_s24 = noor_pcm_kernel_for(&(noor_wav_info_t){ .format = NOOR_WAV_FORMAT_PCM, .sample_rate = NOOR_AUDIO_OUT_RATE, .channels = 2, .bits_per_sample = 24 });
+    const size_t s24_frames = ns * sizeof(int16_t) / k_s24->frame_bytes;   // as many as src holds
+    for (int r = 0; r < BENCH_REPEAT; ++r) {
+        uint32_t c0;
+        int32_t cur;
+        size_t used, out;
+        noor_conv_t conv;
+
+        memcpy(buf, src, ns * sizeof(int16_t));
+        c0 = esp_cpu_get_cycle_count();
+        gain_legacy(buf, ns, 70);
+        v[K_LEGACY][r] = (double)(esp_cpu_get_cycle_count() - c0) / ns;
+
+        memcpy(buf, src, ns * sizeof(int16_t));
+        cur = noor_volume_to_q15(70);
+        c0 = esp_cpu_get_cycle_count();
+        noor_gain_apply(buf, frames, 2, &cur, cur);
+        v[K_STEADY][r] = (double)(esp_cpu_get_cycle_count() - c0) / ns;
+
+        memcpy(buf, src, ns * sizeof(int16_t));
+        cur = noor_volume_to_q15(70);
+        c0 = esp_cpu_get_cycle_count();
+        noor_gain_apply(buf, frames, 2, &cur, noor_volume_to_q15(150));
+        v[K_RAMP][r] = (double)(esp_cpu_get_cycle_count() - c0) / ns;
+
+        memcpy(buf, src, ns * sizeof(int16_t));
+        cur = noor_volume_to_q15(100);
+        c0 = esp_cpu_get_cycle_count();
+        noor_mix_ducked(buf, voice, frames, &cur, noor_volume_to_q15(100) * BENCH_DUCK_PERCENT / 100, noor_volume_to_q15(100));
+        v[K_DUCK][r] = (double)(esp_cpu_get_cycle_count() - c0) / ns;
+
+        // per output sample: how much of the core one second of converted audio costs
+        noor_conv_setup(&conv, &mono22, true);
+        c0 = esp_cpu_get_cycle_count();
+        out = noor_conv_run(&conv, src, ns, &used, buf, frames);
+        v[K_RS_MONO][r] = out ? (double)(esp_cpu_get_cycle_count() - c0) / (out * 2) : 0;
+
+        noor_conv_setup(&conv, &st48, true);
+        c0 = esp_cpu_get_cycle_count();
+        out = noor_conv_run(&conv, src, frames, &used, buf, frames);
+        v[K_RS_STEREO][r] = out ? (double)(esp_cpu_get_cycle_count() - c0) / (out * 2) : 0;
+
+        // rate-matched kernels, per output sample: slot bytes -> gained stereo in one pass
+        c0 = esp_cpu_get_cycle_count();
+        k_mono->gain((const uint8_t *)src, frames, buf, noor_volume_to_q15(70));
+        v[K_PCM_MONO][r] = (double)(esp_cpu_get_cycle_count() - c0) / ns;
+
+        c0 = esp_cpu_get_cycle_count();
+        k_s24->gain((const uint8_t *)src, s24_frames, buf, noor_volume_to_q15(70));
+        v[K_PCM_S24][r] = (double)(esp_cpu_get_cycle_count() - c0) / (s24_frames * 2);
+    }
+    char params[64];
+    for (int k = 0; k < K_COUNT; ++k) {
+        snprintf(params, sizeof(params), "\"kernel\":\"%s\",\"frames\":%u", names[k], (unsigned)frames);
+        bench_emit("kernel", params, "cycles/sample", v[k], BENCH_REPEAT);
+    }
+    heap_caps_free(src);
+    heap_caps_free(buf);
+    heap_caps_free(voice);
+}
+
+/* ---------- I2S ---------- */
+// The player clocks I2S once; these are the costs it avoids (set_clk) or pays per session (stop/start, flush).
+// Only the engine's output is installed (no engine task), so nothing else touches the port meanwhile.
+static void bench_i2s(void) {
+    noor_audio_config_t cfg = { .pin_bck = I2S_BCK_PIN, .pin_ws = I2S_WS_PIN, .pin_dout = I2S_DO_PIN };
+    if (!noor_audio_output_init(&cfg)) { bench_fail("i2s", "init"); return; }
+    const i2s_port_t port = (i2s_port_t)NOOR_AUDIO_I2S_PORT;
+    double set_clk[BENCH_REPEAT], stop_start[BENCH_REPEAT], flush[BENCH_REPEAT];
+    int n = 0;
+    for (int r = 0; r < BENCH_REPEAT; ++r) {
+        int64_t t0 = esp_timer_get_time();
+        esp_err_t e = i2s_set_clk(port, 22050, I2S_BITS_PER_SAMPLE_16BIT, I2S_CHANNEL_STEREO);
+        set_clk[n] = (double)(esp_timer_get_time() - t0);
+        if (e != ESP_OK || i2s_set_clk(port, NOOR_AUDIO_OUT_RATE, I2S_BITS_PER_SAMPLE_16BIT, I2S_CHANNEL_STEREO) != ESP_OK) break;
+        t0 = esp_timer_get_time();
+        i2s_stop(port);
+        i2s_start(port);
+        stop_start[n] = (double)(esp_timer_get_time() - t0);
+        t0 = esp_timer_get_time();
+        i2s_zero_dma_buffer(port);
+        flush[n] = (double)(esp_timer_get_time() - t0);
+        n++;
+    }
+    bench_emit("i2s", "\"op\":\"set_clk\"", "us", set_clk, n);
+    bench_emit("i2s", "\"op\":\"stop_start\"", "us", stop_start, n);
+    bench_emit("i2s", "\"op\":\"zero_dma\"", "us", flush, n);
+}
+
+/* ---------- app_main ---------- */
+void app_main(void) {
+    ESP_LOGI(TAG, "=== NOOR_BENCH starting (%d runs per result) ===", BENCH_REPEAT);
+    if (!bench_lists_init()) { bench_fail("meta", "no list arenas"); return; }
+    esp_err_t r = noor_card_mount(&card_cfg, &sdcard);
+    if (r != ESP_OK) { ESP_LOGE(TAG, "Failed to mount SD: %s", esp_err_to_name(r)); bench_fail("meta", "sd mount failed"); return; }
+    mkdir(BENCH_DIR, 0777);
+    esp_log_level_set("*", ESP_LOG_WARN);   // per-entry INFO lines would be timed along with the scans
+    bench_meta();
+    bench_sd_read();
+    bench_scan_tracks();
+    bench_scan_folders();
+    bench_parse_header();
+    bench_kernels();
+    bench_i2s();
+    printf("BENCH {\"bench\":\"done\"}\n");
+}
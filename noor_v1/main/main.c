@@ -5,6 +5,7 @@
 // SD (SPI): CS=GPIO10, MOSI=GPIO11, SCK=GPIO12, MISO=GPIO13
 // Buttons: PlayPause=GPIO14, Home=GPIO15, Vol+ = GPIO4, Vol- = GPIO5
 // Rotary encoder: CLK=GPIO1 (rising-edge), DT=GPIO2 (read level), SW(push)=GPIO19 (rising-edge)
+// Playback: shared noor_audio engine (components/noor_audio), driven through its command API
 
 #include <stdio.h>
 #include <string.h>
@@ -19,13 +20,13 @@
 #include "freertos/task.h"
 #include "freertos/queue.h"
 #include "driver/gpio.h"
-#include "driver/i2s.h"
 #include "esp_log.h"
 #include "esp_vfs_fat.h"
 #include "sdmmc_cmd.h"
 #include "driver/spi_common.h"
 #include "driver/spi_master.h"
 #include "driver/sdspi_host.h"
+#include "noor_audio.h"
 
 static const char *TAG = "NAV_PLAYER_ISR";
 
@@ -54,16 +55,14 @@ static const char *TAG = "NAV_PLAYER_ISR";
 #define MAX_WAV_FILES 64
 #define MAX_FOLDERS 32
 #define ENC_QUEUE_LEN 16
+#define AUDIO_SYNC_TIMEOUT_MS 2000   // longest wait for the engine to let go of the track list
 
 /* ---------- navigation state ---------- */
 typedef enum { NAV_HOME = 0, NAV_FOLDER_VIEW, NAV_FILE_VIEW } nav_state_t;
 static volatile nav_state_t nav_state = NAV_HOME;
 
 /* ---------- playback & control globals ---------- */
-static volatile bool g_pause = false;         // pause flag when playing
-static volatile bool g_playing = false;       // true when actively playing
-static volatile bool g_stop_and_rewind = false;
-static volatile int g_volume_percent = 100;   // 0-200%
+static int g_volume_percent = 100;            // 0-200%, requested from the engine
 
 /* ---------- lists ---------- */
 static char *folder_list[MAX_FOLDERS];
@@ -73,8 +72,6 @@ static int selected_folder = 0;
 static char *wav_list[MAX_WAV_FILES];
 static volatile int num_tracks = 0;
 static volatile int current_track = 0;        // selection index in file view
-static volatile int playing_track = -1;       // -1 none
-static volatile bool track_change_request = false;
 
 /* ---------- sd mount ---------- */
 esp_vfs_fat_mount_config_t mount_cfg = {
@@ -85,12 +82,6 @@ esp_vfs_fat_mount_config_t mount_cfg = {
 sdmmc_card_t *sdcard = NULL;
 
 /* ---------- helpers ---------- */
-static inline int16_t clip16(int32_t s) {
-    if (s > 32767) return 32767;
-    if (s < -32768) return -32768;
-    return (int16_t)s;
-}
-
 static char *make_path(const char *dir, const char *name) {
     size_t need = strlen(dir) + 1 + strlen(name) + 1;
     char *p = malloc(need);
@@ -103,7 +94,9 @@ static void free_folder_list(void) {
     for (int i = 0; i < num_folders; ++i) { free(folder_list[i]); folder_list[i] = NULL; }
     num_folders = 0; selected_folder = 0;
 }
+// The engine may be reading wav_list: stop it and wait until it has let go first.
 static void free_wav_list(void) {
+    if (num_tracks > 0 && !noor_audio_stop_sync(AUDIO_SYNC_TIMEOUT_MS)) ESP_LOGW(TAG, "audio engine did not confirm STOP");
     for (int i = 0; i < num_tracks; ++i) { free(wav_list[i]); wav_list[i] = NULL; }
     num_tracks = 0; current_track = 0;
 }
@@ -240,6 +233,34 @@ static bool read_button_press(btn_t *b) {
     return false;
 }
 
+/* ---------- audio engine glue ---------- */
+// Called from the engine task; wav_list only changes behind the STOP barrier in free_wav_list().
+static bool engine_track(int idx, noor_source_t *out, void *ctx) {
+    if (idx < 0 || idx >= num_tracks || !wav_list[idx]) return false;
+    *out = (noor_source_t){ .path = wav_list[idx], .meta = NULL };
+    return true;
+}
+
+static void init_audio(void) {
+    noor_audio_config_t cfg = {
+        .pin_bck = I2S_BCK_PIN, .pin_ws = I2S_WS_PIN, .pin_dout = I2S_DO_PIN,
+        .track = engine_track,
+    };
+    if (!noor_audio_init(&cfg)) ESP_LOGE(TAG, "Audio engine init failed - playback disabled");
+}
+
+// Play/Pause in FILE_VIEW: start the selection, toggle pause if it is the one playing, or switch to it.
+static void request_play_pause(const char *who) {
+    if (num_tracks <= 0) { ESP_LOGI(TAG, "No tracks to play"); return; }
+    if (noor_audio_is_playing() && noor_audio_playing_track() == current_track) {
+        noor_audio_pause(-1);
+        ESP_LOGI(TAG, "%s: toggle pause", who);
+    } else {
+        noor_audio_play(current_track);
+        ESP_LOGI(TAG, "%s: play selected %d", who, current_track);
+    }
+}
+
 /* ---------- encoder ISR-driven implementation ---------- */
 typedef enum { ENC_EVT_CLK = 1, ENC_EVT_SW = 2 } enc_evt_type_t;
 typedef struct {
@@ -300,33 +321,13 @@ static void encoder_task(void *arg) {
                 last_sw_time = now;
                 // emulate Play/Pause press
                 if (nav_state == NAV_FILE_VIEW) {
-                    if (!g_playing) {
-                        if (num_tracks > 0) {
-                            playing_track = current_track;
-                            g_playing = true;
-                            g_pause = false;
-                            track_change_request = true;
-                            ESP_LOGI(TAG, "Encoder SW: start playing selected %d", playing_track);
-                        }
-                    } else {
-                        if (playing_track == current_track) {
-                            g_pause = !g_pause;
-                            ESP_LOGI(TAG, "Encoder SW: toggle pause -> %s", g_pause ? "PAUSED" : "PLAYING");
-                        } else {
-                            playing_track = current_track;
-                            g_pause = false;
-                            track_change_request = true;
-                            ESP_LOGI(TAG, "Encoder SW: switch playing to %d", playing_track);
-                        }
-                    }
+                    request_play_pause("Encoder SW");
                 } else if (nav_state == NAV_FOLDER_VIEW) {
                     if (num_folders > 0) {
                         const char *fp = folder_list[selected_folder];
                         scan_wavs_in_folder(fp);
                         nav_state = NAV_FILE_VIEW;
                         current_track = 0;
-                        playing_track = -1;
-                        g_playing = false; g_pause = false;
                         ESP_LOGI(TAG, "Entered folder via encoder SW: %s", fp);
                     }
                 } else if (nav_state == NAV_HOME) {
@@ -337,110 +338,12 @@ static void encoder_task(void *arg) {
     }
 }
 
-/* ---------- WAV header parse (simple 44-byte) ---------- */
-typedef struct {
-    uint32_t sample_rate;
-    uint16_t bits_per_sample;
-    uint16_t channels;
-    uint32_t data_size;
-    uint32_t data_offset;
-} wav_info_t;
-
-static bool parse_wav_header(FILE *f, wav_info_t *info) {
-    uint8_t header[44];
-    if (fread(header, 1, 44, f) != 44) { ESP_LOGE(TAG, "Failed to read WAV header"); return false; }
-    if (memcmp(header, "RIFF", 4) != 0 || memcmp(header + 8, "WAVE", 4) != 0) { ESP_LOGE(TAG, "Not a RIFF/WAVE file"); return false; }
-    info->channels = *((uint16_t *)(header + 22));
-    info->sample_rate = *((uint32_t *)(header + 24));
-    info->bits_per_sample = *((uint16_t *)(header + 34));
-    info->data_size = *((uint32_t *)(header + 40));
-    info->data_offset = 44;
-    ESP_LOGI(TAG, "WAV: ch=%d sr=%d bits=%d data=%u", info->channels, info->sample_rate, info->bits_per_sample, info->data_size);
-    return true;
-}
-
-/* ---------- audio task ---------- */
-static void audio_task(void *arg) {
-    while (1) {
-        if (!g_playing) { vTaskDelay(pdMS_TO_TICKS(200)); continue; }
-        if (nav_state != NAV_FILE_VIEW) { g_playing = false; playing_track = -1; vTaskDelay(pdMS_TO_TICKS(200)); continue; }
-        if (num_tracks == 0) { vTaskDelay(pdMS_TO_TICKS(200)); continue; }
-
-        int idx = playing_track;
-        if (idx < 0 || idx >= num_tracks) { ESP_LOGW(TAG, "Invalid playing_track %d", idx); g_playing = false; playing_track = -1; vTaskDelay(pdMS_TO_TICKS(200)); continue; }
-
-        char *filename = wav_list[idx];
-        if (!filename) { vTaskDelay(pdMS_TO_TICKS(200)); continue; }
-
-        FILE *f = fopen(filename, "rb");
-        if (!f) { ESP_LOGE(TAG, "Failed to open %s", filename); vTaskDelay(pdMS_TO_TICKS(500)); continue; }
-        ESP_LOGI(TAG, "Playing %d: %s", idx, filename);
-
-        wav_info_t winfo;
-        if (!parse_wav_header(f, &winfo)) { fclose(f); vTaskDelay(pdMS_TO_TICKS(500)); continue; }
-        if (winfo.bits_per_sample != 16) { ESP_LOGE(TAG, "Only 16-bit PCM supported"); fclose(f); vTaskDelay(pdMS_TO_TICKS(500)); continue; }
-
-        i2s_config_t i2s_cfg = {
-            .mode = I2S_MODE_MASTER | I2S_MODE_TX,
-            .sample_rate = (int)winfo.sample_rate,
-            .bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT,
-            .channel_format = (winfo.channels == 1) ? I2S_CHANNEL_FMT_ONLY_LEFT : I2S_CHANNEL_FMT_RIGHT_LEFT,
-            .communication_format = I2S_COMM_FORMAT_I2S,
-            .intr_alloc_flags = 0,
-            .dma_buf_count = 4,
-            .dma_buf_len = 1024,
-            .use_apll = false,
-            .tx_desc_auto_clear = true
-        };
-        i2s_pin_config_t pin_cfg = { .bck_io_num = I2S_BCK_PIN, .ws_io_num = I2S_WS_PIN, .data_out_num = I2S_DO_PIN, .data_in_num = I2S_PIN_NO_CHANGE };
-
-        esp_err_t r = i2s_driver_install(I2S_NUM_0, &i2s_cfg, 0, NULL);
-        if (r != ESP_OK) { ESP_LOGE(TAG, "i2s_driver_install failed: %s", esp_err_to_name(r)); fclose(f); vTaskDelay(pdMS_TO_TICKS(500)); continue; }
-        r = i2s_set_pin(I2S_NUM_0, &pin_cfg);
-        if (r != ESP_OK) { ESP_LOGE(TAG, "i2s_set_pin failed: %s", esp_err_to_name(r)); i2s_driver_uninstall(I2S_NUM_0); fclose(f); vTaskDelay(pdMS_TO_TICKS(500)); continue; }
-        r = i2s_set_clk(I2S_NUM_0, winfo.sample_rate, I2S_BITS_PER_SAMPLE_16BIT, winfo.channels);
-        if (r != ESP_OK) ESP_LOGW(TAG, "i2s_set_clk: %s", esp_err_to_name(r));
-
-        fseek(f, winfo.data_offset, SEEK_SET);
-        const size_t chunk_bytes = 1024 * (winfo.bits_per_sample / 8) * winfo.channels;
-        uint8_t *read_buf = malloc(chunk_bytes);
-        if (!read_buf) { ESP_LOGE(TAG, "No mem"); fclose(f); i2s_driver_uninstall(I2S_NUM_0); vTaskDelay(pdMS_TO_TICKS(500)); continue; }
-
-        while (g_playing) {
-            if (track_change_request) { track_change_request = false; ESP_LOGI(TAG, "Track change requested -> %d", playing_track); break; }
-            if (g_stop_and_rewind) { g_stop_and_rewind = false; fseek(f, winfo.data_offset, SEEK_SET); ESP_LOGI(TAG, "Stop & rewind"); }
-            if (g_pause) { vTaskDelay(pdMS_TO_TICKS(50)); continue; }
-
-            size_t bytes_read = fread(read_buf, 1, chunk_bytes, f);
-            if (bytes_read == 0) { fseek(f, winfo.data_offset, SEEK_SET); continue; }
-
-            if (g_volume_percent != 100) {
-                int16_t *samps = (int16_t *)read_buf;
-                size_t ns = bytes_read / 2;
-                for (size_t i = 0; i < ns; ++i) {
-                    int32_t scaled = ((int32_t)samps[i] * g_volume_percent) / 100;
-                    samps[i] = clip16(scaled);
-                }
-            }
-
-            size_t bw = 0;
-            esp_err_t res = i2s_write(I2S_NUM_0, read_buf, bytes_read, &bw, pdMS_TO_TICKS(1000));
-            if (res != ESP_OK) ESP_LOGW(TAG, "i2s_write: %s", esp_err_to_name(res));
-            vTaskDelay(pdMS_TO_TICKS(1));
-        }
-
-        free(read_buf);
-        fclose(f);
-        i2s_driver_uninstall(I2S_NUM_0);
-        vTaskDelay(pdMS_TO_TICKS(100));
-    }
-}
-
 /* ---------- app_main ---------- */
 void app_main(void) {
     ESP_LOGI(TAG, "=== NAV_PLAYER starting (HOME) ===");
 
     init_inputs();
+    init_audio();
 
     if (!init_sd()) {
         ESP_LOGE(TAG, "SD init failed - check wiring and card");
@@ -477,8 +380,7 @@ void app_main(void) {
         ESP_LOGI(TAG, "Encoder ISRs installed (CLK rising, SW rising)");
     }
 
-    // create tasks: audio and encoder
-    xTaskCreatePinnedToCore(audio_task, "audio_task", 8192, NULL, 5, NULL, tskNO_AFFINITY);
+    // create tasks: encoder (the audio engine started its own in init_audio)
     xTaskCreatePinnedToCore(encoder_task, "encoder_task", 4096, NULL, 3, NULL, tskNO_AFFINITY);
 
     // main loop: handle buttons & navigation
@@ -496,39 +398,17 @@ void app_main(void) {
                     scan_wavs_in_folder(fp);
                     nav_state = NAV_FILE_VIEW;
                     current_track = 0;
-                    playing_track = -1;
-                    g_playing = false;
-                    g_pause = false;
                     ESP_LOGI(TAG, "Entered folder %s (files=%d)", fp, num_tracks);
                 }
             } else if (nav_state == NAV_FILE_VIEW) {
-                if (!g_playing) {
-                    if (num_tracks > 0) {
-                        playing_track = current_track;
-                        g_playing = true;
-                        g_pause = false;
-                        track_change_request = true;
-                        ESP_LOGI(TAG, "Start playing selected file %d", playing_track);
-                    } else ESP_LOGI(TAG, "No tracks to play");
-                } else {
-                    if (playing_track == current_track) {
-                        g_pause = !g_pause;
-                        ESP_LOGI(TAG, "Toggle pause -> %s", g_pause ? "PAUSED" : "PLAYING");
-                    } else {
-                        playing_track = current_track;
-                        g_pause = false;
-                        track_change_request = true;
-                        ESP_LOGI(TAG, "Switch playing to selected file %d", playing_track);
-                    }
-                }
+                request_play_pause("Play/Pause");
             }
         }
 
         if (read_button_press(&btn_home)) {
             ESP_LOGI(TAG, "Home pressed (nav=%d)", nav_state);
             if (nav_state == NAV_FILE_VIEW) {
-                if (g_playing) { g_playing = false; g_pause = false; g_stop_and_rewind = true; }
-                free_wav_list();
+                free_wav_list();   // stops playback first
                 nav_state = NAV_FOLDER_VIEW;
                 ESP_LOGI(TAG, "FILE_VIEW -> FOLDER_VIEW");
             } else if (nav_state == NAV_FOLDER_VIEW) {
@@ -537,8 +417,8 @@ void app_main(void) {
             } else ESP_LOGI(TAG, "Already at HOME");
         }
 
-        if (read_button_press(&btn_volp)) { g_volume_percent += 10; if (g_volume_percent > 200) g_volume_percent = 200; ESP_LOGI(TAG, "Volume + -> %d%%", g_volume_percent); }
-        if (read_button_press(&btn_volm)) { g_volume_percent -= 10; if (g_volume_percent < 0) g_volume_percent = 0; ESP_LOGI(TAG, "Volume - -> %d%%", g_volume_percent); }
+        if (read_button_press(&btn_volp)) { g_volume_percent += 10; if (g_volume_percent > 200) g_volume_percent = 200; noor_audio_set_gain(g_volume_percent); ESP_LOGI(TAG, "Volume + -> %d%%", g_volume_percent); }
+        if (read_button_press(&btn_volm)) { g_volume_percent -= 10; if (g_volume_percent < 0) g_volume_percent = 0; noor_audio_set_gain(g_volume_percent); ESP_LOGI(TAG, "Volume - -> %d%%", g_volume_percent); }
 
         vTaskDelay(pdMS_TO_TICKS(10));
     }
@@ -3,7 +3,9 @@
 // - Plays welcome.wav then home.wav on boot
 // - When at HOME, selecting stories folder auto-plays stories.wav
 // - Entering stories folder: announcements for S1..S5 (story1.wav..story5.wav) play on selection
-// - Announcements interrupt normal playback; any interaction interrupts announcements
+// - Announcements are mixed over a playing track when cached, otherwise they interrupt it;
+//   any interaction interrupts announcements
+// - Playback: shared noor_audio engine (components/noor_audio), driven through its command API
 // Pins: I2S BCLK=18 WS=17 DIN=16
 // SD SPI: CS=10 MOSI=11 SCK=12 MISO=13
 // Buttons: PlayPause=14 Home=15 Vol+=4 Vol-=5 (active HIGH, pull-down)
@@ -23,13 +25,13 @@
 #include "freertos/task.h"
 #include "freertos/queue.h"
 #include "driver/gpio.h"
-#include "driver/i2s.h"
 #include "esp_log.h"
 #include "esp_vfs_fat.h"
 #include "sdmmc_cmd.h"
 #include "driver/spi_common.h"
 #include "driver/spi_master.h"
 #include "driver/sdspi_host.h"
+#include "noor_audio.h"
 
 static const char *TAG = "NAV_PLAYER_ANN";
 
@@ -58,16 +60,15 @@ static const char *TAG = "NAV_PLAYER_ANN";
 #define MAX_FOLDERS 32
 #define ENC_QUEUE_LEN 16
 #define ANNOUNCE_PATH_MAX 256
+#define ANN_SLOTS 4                  // announcement paths in flight to the engine
+#define AUDIO_SYNC_TIMEOUT_MS 2000   // longest wait for the engine to let go of the track list
 
 // ---------- Navigation ----------
 typedef enum { NAV_HOME=0, NAV_FOLDER_VIEW, NAV_FILE_VIEW } nav_state_t;
 static volatile nav_state_t nav_state = NAV_HOME;
 
 // ---------- Controls ----------
-static volatile bool g_pause = false;
-static volatile bool g_playing = false;
-static volatile bool g_stop_and_rewind = false;
-static volatile int g_volume_percent = 100;
+static int g_volume_percent = 100;   // requested from the engine
 
 // ---------- Lists ----------
 static char *folder_list[MAX_FOLDERS];
@@ -77,8 +78,6 @@ static int selected_folder = 0;
 static char *wav_list[MAX_WAV_FILES];
 static volatile int num_tracks = 0;
 static volatile int current_track = 0;    // selection index inside folder
-static volatile int playing_track = -1;   // which file is actively playing
-static volatile bool track_change_request = false;
 
 // ---------- SD mount ----------
 esp_vfs_fat_mount_config_t mount_cfg = {
@@ -89,8 +88,10 @@ esp_vfs_fat_mount_config_t mount_cfg = {
 sdmmc_card_t *sdcard = NULL;
 
 // ---------- Announcement request ----------
-static volatile bool announce_request = false;
-static char announce_path[ANNOUNCE_PATH_MAX];
+// The engine looks the path up by slot when it gets to the command, so each request gets its own
+// buffer; ANN_SLOTS requests can be queued before one is reused.
+static char announce_paths[ANN_SLOTS][ANNOUNCE_PATH_MAX];
+static unsigned announce_next = 0;
 
 // ---------- Encoder queue ----------
 typedef enum { ENC_EVT_CLK = 1, ENC_EVT_SW = 2 } enc_evt_type_t;
@@ -98,12 +99,6 @@ typedef struct { enc_evt_type_t type; uint8_t dt_level; } enc_evt_t;
 static QueueHandle_t enc_queue = NULL;
 
 // ---------- Utility helpers ----------
-static inline int16_t clip16(int32_t s) {
-    if (s > 32767) return 32767;
-    if (s < -32768) return -32768;
-    return (int16_t)s;
-}
-
 static char *make_path(const char *dir, const char *name) {
     size_t need = strlen(dir) + 1 + strlen(name) + 1;
     char *p = malloc(need);
@@ -116,7 +111,9 @@ static void free_folder_list(void) {
     for (int i = 0; i < num_folders; ++i) { free(folder_list[i]); folder_list[i] = NULL; }
     num_folders = 0; selected_folder = 0;
 }
+// The engine may be reading wav_list: stop it and wait until it has let go first.
 static void free_wav_list(void) {
+    if (num_tracks > 0 && !noor_audio_stop_sync(AUDIO_SYNC_TIMEOUT_MS)) ESP_LOGW(TAG, "audio engine did not confirm STOP");
     for (int i = 0; i < num_tracks; ++i) { free(wav_list[i]); wav_list[i] = NULL; }
     num_tracks = 0; current_track = 0;
 }
@@ -244,98 +241,46 @@ static bool read_button_press(btn_t *b) {
     return false;
 }
 
-// ---------- WAV header parsing ----------
-typedef struct {
-    uint32_t sample_rate;
-    uint16_t bits_per_sample;
-    uint16_t channels;
-    uint32_t data_size;
-    uint32_t data_offset;
-} wav_info_t;
-
-static bool parse_wav_header(FILE *f, wav_info_t *info) {
-    uint8_t header[44];
-    if (fread(header,1,44,f) != 44) return false;
-    if (memcmp(header,"RIFF",4)!=0 || memcmp(header+8,"WAVE",4)!=0) return false;
-    info->channels = *((uint16_t*)(header+22));
-    info->sample_rate = *((uint32_t*)(header+24));
-    info->bits_per_sample = *((uint16_t*)(header+34));
-    info->data_size = *((uint32_t*)(header+40));
-    info->data_offset = 44;
+// ---------- Audio engine glue (callbacks run on the engine task) ----------
+// wav_list only changes behind the STOP barrier in free_wav_list().
+static bool engine_track(int idx, noor_source_t *out, void *ctx) {
+    if (idx < 0 || idx >= num_tracks || !wav_list[idx]) return false;
+    *out = (noor_source_t){ .path = wav_list[idx], .meta = NULL };
     return true;
 }
 
-// ---------- Stream file with interruption checks (used by audio_task for announcements and playback) ----------
-static bool stream_file_interruptible(const char *fullpath, volatile bool *stop_flag_ptr) {
-    if (!fullpath) return false;
-    FILE *f = fopen(fullpath, "rb");
-    if (!f) { ESP_LOGW(TAG, "stream_file: not found: %s", fullpath); return false; }
-    wav_info_t winfo;
-    if (!parse_wav_header(f, &winfo)) { ESP_LOGE(TAG, "Invalid WAV header: %s", fullpath); fclose(f); return false; }
-    if (winfo.bits_per_sample != 16) { ESP_LOGE(TAG, "Only 16-bit PCM supported (ann/play): %s", fullpath); fclose(f); return false; }
-
-    i2s_config_t i2s_cfg = {
-        .mode = I2S_MODE_MASTER | I2S_MODE_TX,
-        .sample_rate = (int)winfo.sample_rate,
-        .bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT,
-        .channel_format = (winfo.channels == 1) ? I2S_CHANNEL_FMT_ONLY_LEFT : I2S_CHANNEL_FMT_RIGHT_LEFT,
-        .communication_format = I2S_COMM_FORMAT_I2S,
-        .intr_alloc_flags = 0,
-        .dma_buf_count = 4,
-        .dma_buf_len = 1024,
-        .use_apll = false,
-        .tx_desc_auto_clear = true
-    };
-    i2s_pin_config_t pin_cfg = { .bck_io_num = I2S_BCK_PIN, .ws_io_num = I2S_WS_PIN, .data_out_num = I2S_DO_PIN, .data_in_num = I2S_PIN_NO_CHANGE };
-
-    esp_err_t r = i2s_driver_install(I2S_NUM_0, &i2s_cfg, 0, NULL);
-    if (r != ESP_OK) { ESP_LOGE(TAG, "i2s_driver_install failed: %s", esp_err_to_name(r)); fclose(f); return false; }
-    r = i2s_set_pin(I2S_NUM_0, &pin_cfg);
-    if (r != ESP_OK) { ESP_LOGE(TAG, "i2s_set_pin failed: %s", esp_err_to_name(r)); i2s_driver_uninstall(I2S_NUM_0); fclose(f); return false; }
-    r = i2s_set_clk(I2S_NUM_0, winfo.sample_rate, I2S_BITS_PER_SAMPLE_16BIT, winfo.channels);
-    if (r != ESP_OK) ESP_LOGW(TAG, "i2s_set_clk: %s", esp_err_to_name(r));
-
-    fseek(f, winfo.data_offset, SEEK_SET);
-    const size_t chunk_bytes = 1024 * (winfo.bits_per_sample / 8) * winfo.channels;
-    uint8_t *buf = malloc(chunk_bytes);
-    if (!buf) { ESP_LOGE(TAG, "No mem"); fclose(f); i2s_driver_uninstall(I2S_NUM_0); return false; }
-
-    while (1) {
-        if (stop_flag_ptr && *stop_flag_ptr) {
-            ESP_LOGI(TAG, "stream interrupted: %s", fullpath);
-            break;
-        }
-        size_t bytes_read = fread(buf, 1, chunk_bytes, f);
-        if (bytes_read == 0) break;
-        // apply volume scaling
-        if (g_volume_percent != 100) {
-            int16_t *samps = (int16_t*)buf;
-            size_t ns = bytes_read / 2;
-            for (size_t i=0;i<ns;++i) {
-                int32_t scaled = ((int32_t)samps[i] * g_volume_percent) / 100;
-                samps[i] = clip16(scaled);
-            }
-        }
-        size_t written = 0;
-        esp_err_t res = i2s_write(I2S_NUM_0, buf, bytes_read, &written, pdMS_TO_TICKS(1000));
-        if (res != ESP_OK) ESP_LOGW(TAG, "i2s_write: %s", esp_err_to_name(res));
-        // yield so other tasks can operate and so we can catch interrupts
-        vTaskDelay(pdMS_TO_TICKS(1));
-    }
+static const char *engine_clip(int id, void *ctx) {
+    return (id >= 0 && id < ANN_SLOTS) ? announce_paths[id] : NULL;
+}
 
-    free(buf);
-    fclose(f);
-    i2s_driver_uninstall(I2S_NUM_0);
-    return true;
+static void init_audio(void) {
+    noor_audio_config_t cfg = {
+        .pin_bck = I2S_BCK_PIN, .pin_ws = I2S_WS_PIN, .pin_dout = I2S_DO_PIN,
+        .track = engine_track, .clip = engine_clip,
+    };
+    if (!noor_audio_init(&cfg)) ESP_LOGE(TAG, "Audio engine init failed - playback disabled");
 }
 
 // ---------- Announcement setter (thread-safe-ish) ----------
 static void request_announcement(const char *path) {
     if (!path) return;
-    // copy path into announce_path
-    strncpy(announce_path, path, sizeof(announce_path)-1);
-    announce_path[sizeof(announce_path)-1] = '\0';
-    announce_request = true;
+    // copy path into the next slot; the engine reads it when the command comes up
+    unsigned slot = announce_next++ % ANN_SLOTS;
+    strncpy(announce_paths[slot], path, ANNOUNCE_PATH_MAX - 1);
+    announce_paths[slot][ANNOUNCE_PATH_MAX - 1] = '\0';
+    noor_audio_announce((int)slot);
+}
+
+// Play/Pause in FILE_VIEW: start the selection, toggle pause if it is the one playing, or switch to it.
+static void request_play_pause(const char *who) {
+    if (num_tracks <= 0) { ESP_LOGI(TAG, "No tracks to play"); return; }
+    if (noor_audio_is_playing() && noor_audio_playing_track() == current_track) {
+        noor_audio_pause(-1);
+        ESP_LOGI(TAG, "%s: toggle pause", who);
+    } else {
+        noor_audio_play(current_track);
+        ESP_LOGI(TAG, "%s: play selected %d", who, current_track);
+    }
 }
 
 // ---------- Encoder ISRs (IRAM safe) ----------
@@ -420,15 +365,7 @@ static void encoder_task(void *arg) {
                 last_sw_time = now;
                 // behave like Play/Pause press
                 if (nav_state == NAV_FILE_VIEW) {
-                    if (!g_playing) {
-                        if (num_tracks > 0) {
-                            playing_track = current_track; g_playing = true; g_pause = false; track_change_request = true;
-                            ESP_LOGI(TAG, "Encoder SW: start playing selected %d", playing_track);
-                        }
-                    } else {
-                        if (playing_track == current_track) { g_pause = !g_pause; ESP_LOGI(TAG, "Encoder SW: toggle pause -> %s", g_pause ? "PAUSED":"PLAYING"); }
-                        else { playing_track = current_track; g_pause = false; track_change_request = true; ESP_LOGI(TAG, "Encoder SW: switch to %d", playing_track); }
-                    }
+                    request_play_pause("Encoder SW");
                 } else if (nav_state == NAV_FOLDER_VIEW) {
                     if (num_folders > 0) {
                         const char *folder_path = folder_list[selected_folder];
@@ -442,7 +379,7 @@ static void encoder_task(void *arg) {
                             }
                         }
                         scan_wavs_in_folder(folder_path);
-                        nav_state = NAV_FILE_VIEW; current_track = 0; playing_track = -1; g_playing = false; g_pause = false;
+                        nav_state = NAV_FILE_VIEW; current_track = 0;
                         ESP_LOGI(TAG, "Entered folder via encoder SW: %s (files=%d)", folder_path, num_tracks);
                         // announce current file (S1) immediately if S1 exists -> so trigger announcement for current selection
                         if (num_tracks > 0) {
@@ -479,63 +416,12 @@ static void encoder_task(void *arg) {
     }
 }
 
-// ---------- Audio task (handles announcements and normal playback, interruptible) ----------
-static void audio_task(void *arg) {
-    ESP_LOGI(TAG, "audio_task started");
-    while (1) {
-        // Handle announcement request first (high priority)
-        if (announce_request) {
-            // copy announce path and clear flag
-            char local_ann[ANNOUNCE_PATH_MAX];
-            strncpy(local_ann, announce_path, sizeof(local_ann)-1);
-            local_ann[sizeof(local_ann)-1] = '\0';
-            announce_request = false;
-            ESP_LOGI(TAG, "Announcement requested: %s", local_ann);
-
-            // Interrupt normal playback if any
-            track_change_request = false;
-            g_playing = false; // stopping any playing track; user interaction interrupts playback
-            // Play announcement with stop_flag pointer = &announce_request (so new announcements interrupt this)
-            stream_file_interruptible(local_ann, (volatile bool *)&announce_request);
-            // finished one announcement, continue loop to check for new announcements or playback
-            continue;
-        }
-
-        // Normal playback if requested
-        if (g_playing) {
-            if (nav_state != NAV_FILE_VIEW) {
-                // only play when inside folder
-                g_playing = false; playing_track = -1;
-                vTaskDelay(pdMS_TO_TICKS(200)); continue;
-            }
-            if (num_tracks == 0) { g_playing = false; vTaskDelay(pdMS_TO_TICKS(200)); continue; }
-            int idx = playing_track;
-            if (idx < 0 || idx >= num_tracks) { ESP_LOGW(TAG, "Invalid playing_track %d", idx); g_playing=false; playing_track=-1; vTaskDelay(pdMS_TO_TICKS(200)); continue; }
-            char *file_to_play = wav_list[idx];
-            if (!file_to_play) { vTaskDelay(pdMS_TO_TICKS(200)); continue; }
-            ESP_LOGI(TAG, "Start playing track %d: %s", idx, file_to_play);
-
-            // While streaming, monitor announce_request; if it becomes true, we must stop immediately
-            stream_file_interruptible(file_to_play, (volatile bool *)&announce_request);
-
-            // After streaming (either finished or interrupted), clear playing flags if interrupted by announce
-            if (announce_request) { // if announcement now queued, playback was interrupted
-                g_playing = false; playing_track = -1;
-                continue;
-            }
-            vTaskDelay(pdMS_TO_TICKS(50));
-            continue;
-        }
-
-        vTaskDelay(pdMS_TO_TICKS(100));
-    }
-}
-
 // ---------- Encoder ISR setup & app main ----------
 void app_main(void) {
     ESP_LOGI(TAG, "=== NAV_PLAYER (announcements) starting ===");
 
     init_inputs();
+    init_audio();
 
     if (!init_sd()) {
         ESP_LOGE(TAG, "SD init failed - check wiring/card");
@@ -554,8 +440,8 @@ void app_main(void) {
         } else ESP_LOGW(TAG, "No folders found at /sdcard");
 
         // Play welcome + home on boot if present
-        if (access("/sdcard/welcome.wav", F_OK) == 0) stream_file_interruptible("/sdcard/welcome.wav", NULL);
-        if (access("/sdcard/home.wav", F_OK) == 0) stream_file_interruptible("/sdcard/home.wav", NULL);
+        if (access("/sdcard/welcome.wav", F_OK) == 0) noor_audio_play_clip("/sdcard/welcome.wav");
+        if (access("/sdcard/home.wav", F_OK) == 0) noor_audio_play_clip("/sdcard/home.wav");
         // After boot greetings, we are in HOME (nav_state default) — no need to request_announcement here because we just played home.wav.
     }
 
@@ -572,7 +458,6 @@ void app_main(void) {
     }
 
     // create tasks
-    xTaskCreatePinnedToCore(audio_task, "audio_task", 8192, NULL, 5, NULL, tskNO_AFFINITY);
     xTaskCreatePinnedToCore(encoder_task, "encoder_task", 4096, NULL, 3, NULL, tskNO_AFFINITY);
 
     // main loop: handle buttons & navigation, plus play announcements when entering HOME or entering folder
@@ -596,7 +481,7 @@ void app_main(void) {
                     }
                     scan_wavs_in_folder(folder_path);
                     nav_state = NAV_FILE_VIEW;
-                    current_track = 0; playing_track = -1; g_playing = false; g_pause = false;
+                    current_track = 0;
                     ESP_LOGI(TAG, "Entered folder %s (files=%d)", folder_path, num_tracks);
                     // announce current selection inside folder (S1) if pattern matches
                     if (num_tracks > 0) {
@@ -626,22 +511,13 @@ void app_main(void) {
                     }
                 }
             } else if (nav_state == NAV_FILE_VIEW) {
-                if (!g_playing) {
-                    if (num_tracks > 0) {
-                        playing_track = current_track; g_playing = true; g_pause = false; track_change_request = true;
-                        ESP_LOGI(TAG, "Start playing selected file %d", playing_track);
-                    } else ESP_LOGI(TAG, "No tracks to play");
-                } else {
-                    if (playing_track == current_track) { g_pause = !g_pause; ESP_LOGI(TAG, "Toggle pause -> %s", g_pause ? "PAUSED":"PLAYING"); }
-                    else { playing_track = current_track; g_pause = false; track_change_request = true; ESP_LOGI(TAG, "Switch playing to selected file %d", playing_track); }
-                }
+                request_play_pause("Play/Pause");
             }
         }
 
         if (read_button_press(&btn_home)) {
             ESP_LOGI(TAG, "Home pressed (nav=%d)", nav_state);
             if (nav_state == NAV_FILE_VIEW) {
-                if (g_playing) { g_playing = false; g_pause = false; g_stop_and_rewind = true; }
                 free_wav_list(); nav_state = NAV_FOLDER_VIEW; ESP_LOGI(TAG, "FILE_VIEW -> FOLDER_VIEW");
             } else if (nav_state == NAV_FOLDER_VIEW) {
                 nav_state = NAV_HOME;
@@ -651,8 +527,8 @@ void app_main(void) {
             } else ESP_LOGI(TAG, "Already at HOME");
         }
 
-        if (read_button_press(&btn_volp)) { g_volume_percent += 10; if (g_volume_percent>200) g_volume_percent=200; ESP_LOGI(TAG, "Vol+ -> %d%%", g_volume_percent); }
-        if (read_button_press(&btn_volm)) { g_volume_percent -= 10; if (g_volume_percent<0) g_volume_percent=0; ESP_LOGI(TAG, "Vol- -> %d%%", g_volume_percent); }
+        if (read_button_press(&btn_volp)) { g_volume_percent += 10; if (g_volume_percent>200) g_volume_percent=200; noor_audio_set_gain(g_volume_percent); ESP_LOGI(TAG, "Vol+ -> %d%%", g_volume_percent); }
+        if (read_button_press(&btn_volm)) { g_volume_percent -= 10; if (g_volume_percent<0) g_volume_percent=0; noor_audio_set_gain(g_volume_percent); ESP_LOGI(TAG, "Vol- -> %d%%", g_volume_percent); }
 
         vTaskDelay(pdMS_TO_TICKS(10));
     }